@@ -0,0 +1,101 @@
+/**
+ * File: flood.cc
+ * --------------
+ * A conduit-like program for measuring pipeline throughput.  By default
+ * it publishes --bytes bytes to standard output in --block sized writes.
+ * With --drain, it instead consumes standard input until EOF, and then
+ * reports how much it read and how quickly.  Sizes can be followed by
+ * K, M, or G, as with
+ *
+ *     ./flood --bytes 4G | ./flood --drain
+ */
+#include "stsh-parser/stsh-size.h" // for parse_size
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+using namespace std;
+
+static const int kIncorrectUsage = 1;
+static void printUsage(const string& message, const string& executable) {
+  cerr << "Error: " << message << endl;
+  cerr << "Usage: ./" << executable << " [--bytes n] [--block n] [--drain]" << endl;
+  exit(kIncorrectUsage);
+}
+
+static size_t parseSize(const char *arg, const string& executable) {
+  size_t size;
+  if (!parse_size(arg, size)) printUsage("Malformed size.", executable);
+  return size;
+}
+
+static void extractArguments(int argc, char *argv[], size_t& bytes, size_t& block, bool& drain) {
+  struct option options[] = {
+    {"bytes", required_argument, NULL, 'b'},
+    {"block", required_argument, NULL, 'k'},
+    {"drain", no_argument, NULL, 'd'},
+    {NULL, 0, NULL, 0},
+  };
+  
+  while (true) {
+    int ch = getopt_long(argc, argv, "b:k:d", options, NULL);
+    if (ch == -1) break;
+    switch (ch) {
+    case 'b':
+      bytes = parseSize(optarg, argv[0]);
+      break;
+    case 'k':
+      block = parseSize(optarg, argv[0]);
+      break;
+    case 'd':
+      drain = true;
+      break;
+    default:
+      printUsage("Unrecognized flag.", argv[0]);
+    }
+  }
+  
+  argc -= optind;
+  if (argc > 0) printUsage("Too many arguments.", argv[0]);
+  if (block == 0) printUsage("Block size must be positive.", argv[0]);
+}
+
+static double now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+  size_t bytes = 1 << 30, block = 1 << 16;
+  bool drain = false;
+  extractArguments(argc, argv, bytes, block, drain);
+  vector<char> buffer(block, 'x');
+  if (!drain) {
+    while (bytes > 0) {
+      ssize_t written = write(STDOUT_FILENO, buffer.data(), min(bytes, block));
+      if (written <= 0) return 1;
+      bytes -= written;
+    }
+
+    return 0;
+  }
+
+  double start = now();
+  size_t total = 0;
+  while (true) {
+    ssize_t count = read(STDIN_FILENO, buffer.data(), block);
+    if (count <= 0) break;
+    total += count;
+  }
+
+  double elapsed = now() - start;
+  double mib = total / double(1 << 20);
+  cerr << fixed << setprecision(3) << mib << " MiB in " << elapsed << "s ("
+       << (elapsed > 0 ? mib / elapsed : 0) << " MiB/s)" << endl;
+  return 0;
+}
@@ -0,0 +1,104 @@
+/**
+ * File: startup.cc
+ * ----------------
+ * Measures how long a command takes to start up and run to completion,
+ * which for something like
+ *
+ *     ./startup --runs 500 ./stsh -c true
+ *
+ * is stsh's time to its first command: everything it does before it can
+ * launch true, plus true itself.  The command is run --runs times, one at
+ * a time, and the fastest, median, mean, and 90th percentile wall-clock
+ * times are reported.  With no command, ./stsh -c true is measured.
+ */
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <time.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/wait.h>
+using namespace std;
+
+static const int kIncorrectUsage = 1;
+static const int kCommandFailed = 2;
+static void printUsage(const string& message, const string& executable) {
+  cerr << "Error: " << message << endl;
+  cerr << "Usage: ./" << executable << " [--runs n] [command [arg ...]]" << endl;
+  exit(kIncorrectUsage);
+}
+
+static size_t extractArguments(int argc, char *argv[]) {
+  struct option options[] = {
+    {"runs", required_argument, NULL, 'r'},
+    {NULL, 0, NULL, 0},
+  };
+
+  size_t runs = 200;
+  while (true) {
+    int ch = getopt_long(argc, argv, "+r:", options, NULL); // + stops at the command
+    if (ch == -1) break;
+    switch (ch) {
+    case 'r': {
+      char *end;
+      runs = strtoul(optarg, &end, 10);
+      if (*end != '\0' || runs == 0) printUsage("Number of runs must be a positive integer.", argv[0]);
+      break;
+    }
+    default:
+      printUsage("Unrecognized flag.", argv[0]);
+    }
+  }
+
+  return runs;
+}
+
+static double now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+extern char **environ;
+static double runOnce(char *argv[]) {
+  double start = now();
+  pid_t pid;
+  int err = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+  if (err != 0) {
+    cerr << argv[0] << ": " << strerror(err) << endl;
+    exit(kCommandFailed);
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+  double elapsed = now() - start;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    cerr << argv[0] << " didn't exit cleanly." << endl;
+    exit(kCommandFailed);
+  }
+
+  return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+  size_t runs = extractArguments(argc, argv);
+  static char *defaultCommand[] = {(char *) "./stsh", (char *) "-c", (char *) "true", NULL};
+  char **command = optind < argc ? argv + optind : defaultCommand;
+  runOnce(command); // warm the page cache before anything is measured
+  vector<double> times;
+  for (size_t i = 0; i < runs; i++) times.push_back(runOnce(command));
+  sort(times.begin(), times.end());
+  double total = 0;
+  for (double time: times) total += time;
+
+  for (char **arg = command; *arg != NULL; arg++) cout << (arg == command ? "" : " ") << *arg;
+  cout << fixed << setprecision(3) << ": " << runs << " runs, min " << times.front() * 1e3
+       << "ms, median " << times[runs / 2] * 1e3 << "ms, mean " << total / runs * 1e3
+       << "ms, p90 " << times[runs * 9 / 10] * 1e3 << "ms" << endl;
+  return 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * File: stsh-builtins.cc
+ * ----------------------
+ * Presents the implementation of the STSHBuiltinTable class.
+ */
+
+#include "stsh-builtins.h"
+#include "stsh-exception.h"
+#include <cstring>
+using namespace std;
+
+static const uint32_t kSeedStep = 0x9e3779b9; // consecutive seeds differ in many bits
+static const size_t kSeedsPerSize = 256;      // seeds tried before doubling the table
+static const uint32_t kOffsetBasis = 2166136261u;
+
+/**
+ * Function: hashBuiltinName
+ * -------------------------
+ * Hashes the provided name (FNV-1a, starting from seed instead of the usual
+ * offset basis).
+ */
+static uint32_t hashBuiltinName(const char *name, uint32_t seed) {
+  for (; *name != '\0'; name++) seed = (seed ^ static_cast<unsigned char>(*name)) * 16777619u;
+  return seed;
+}
+
+void STSHBuiltinTable::add(const char *name, STSHBuiltinHandler handler) {
+  if (lookup(name) != NULL) throw STSHException(string("Builtin ") + name + " is already registered.");
+  entry e = { name, handler };
+  entries.push_back(e);
+  rebuild();
+}
+
+STSHBuiltinHandler STSHBuiltinTable::lookup(const char *name) const {
+  if (slots.empty()) return NULL;
+  const entry& e = slots[hashBuiltinName(name, seed) & mask];
+  return e.name != NULL && strcmp(e.name, name) == 0 ? e.handler : NULL;
+}
+
+/**
+ * Method: rebuild
+ * ---------------
+ * Searches for a seed under which every registered name hashes to a
+ * different slot, starting with a table at least twice as large as the
+ * number of names (so a suitable seed turns up quickly) and doubling it
+ * whenever kSeedsPerSize seeds in a row fail.
+ */
+void STSHBuiltinTable::rebuild() {
+  size_t size = 1;
+  while (size < 2 * entries.size()) size <<= 1;
+  const entry empty = { NULL, NULL };
+  for (uint32_t candidate = kOffsetBasis; true; size <<= 1) {
+    for (size_t attempt = 0; attempt < kSeedsPerSize; attempt++, candidate += kSeedStep) {
+      vector<entry> laidOut(size, empty);
+      bool collided = false;
+      for (const entry& e: entries) {
+        entry& slot = laidOut[hashBuiltinName(e.name, candidate) & (size - 1)];
+        if (slot.name != NULL) {
+          collided = true;
+          break;
+        }
+
+        slot = e;
+      }
+
+      if (!collided) {
+        slots.swap(laidOut);
+        seed = candidate;
+        mask = size - 1;
+        return;
+      }
+    }
+  }
+}
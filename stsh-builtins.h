@@ -0,0 +1,79 @@
+/**
+ * File: stsh-builtins.h
+ * ---------------------
+ * Defines the STSHBuiltinTable class, which maps the names of shell builtins
+ * to the functions that handle them.  Every line stsh reads is checked
+ * against the table before anything is launched, so lookups are kept to a
+ * single hash of the command name, a single probe, and a single string
+ * comparison, whether or not the command turns out to be a builtin.  The
+ * table stays collision-free (that is, it's a perfect hash table) because
+ * it is rebuilt with a fresh seed whenever a newly added name collides.
+ *
+ * The table is built at run time, as builtins register themselves at
+ * startup, rather than generated at compile time: C++0x constexpr functions
+ * are limited to a single return statement, which rules out searching for a
+ * seed, and a table fixed at compile time couldn't offer the add method
+ * below.  The search costs microseconds, once, for the dozen or so builtins.
+ *
+ * Builtins plug in by registering themselves, as with
+ *
+ *     STSHBuiltinTable builtins;
+ *     builtins.add("jobs", [](const pipeline& p) { cout << joblist; });
+ *     ...
+ *     STSHBuiltinHandler handler = builtins.lookup(p.commands[0].command);
+ *     if (handler != NULL) handler(p);
+ */
+
+#pragma once
+#include "stsh-parser/stsh-parse.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * Type: STSHBuiltinHandler
+ * ------------------------
+ * A function that executes a builtin on behalf of the provided pipeline,
+ * throwing an STSHException if it's been used incorrectly.
+ */
+typedef void (*STSHBuiltinHandler)(const pipeline& p);
+
+class STSHBuiltinTable {
+public:
+
+/**
+ * Constructor: STSHBuiltinTable
+ * -----------------------------
+ * Constructs an empty table.
+ */
+  STSHBuiltinTable() : seed(0), mask(0) {}
+
+/**
+ * Method: add
+ * -----------
+ * Registers the provided handler under the provided name, which must
+ * outlive the table (a string literal, typically).  Throws an
+ * STSHException if the name has already been registered.
+ */
+  void add(const char *name, STSHBuiltinHandler handler);
+
+/**
+ * Method: lookup
+ * --------------
+ * Returns the handler registered under the provided name, or NULL if
+ * the name isn't that of a builtin.
+ */
+  STSHBuiltinHandler lookup(const char *name) const;
+
+private:
+  struct entry {
+    const char *name;
+    STSHBuiltinHandler handler;
+  };
+
+  std::vector<entry> entries; // every registered builtin, in registration order
+  std::vector<entry> slots;   // entries laid out so that no two share a slot
+  uint32_t seed;
+  uint32_t mask;              // slots.size() - 1, since the size is always a power of two
+
+  void rebuild();
+};
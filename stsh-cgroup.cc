@@ -0,0 +1,144 @@
+/**
+ * File: stsh-cgroup.cc
+ * --------------------
+ * Presents the implementation of the cgroup functions described in
+ * stsh-cgroup.h.
+ */
+
+#include "stsh-cgroup.h"
+#include "stsh-exception.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+using namespace std;
+
+static string parent; // the group the shell was started in, or empty until enableCgroups succeeds
+
+/**
+ * Function: writeFile
+ * -------------------
+ * Writes text to the named (cgroup interface) file in a single write call,
+ * which is how the kernel expects to receive it, and returns false on error.
+ */
+static bool writeFile(const string& path, const string& text) {
+  int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  bool written = write(fd, text.data(), text.size()) == (ssize_t) text.size();
+  int saved = errno;
+  close(fd);
+  errno = saved;
+  return written;
+}
+
+static string errorMessage(const string& path) {
+  return "cgroups: " + path + ": " + strerror(errno) + ".";
+}
+
+ostream& operator<<(ostream& os, const STSHCgroupStats& stats) {
+  streamsize precision = os.precision();
+  os << "cgroup: " << fixed << setprecision(3) << stats.cpu << "s cpu";
+  os.unsetf(ios::floatfield);
+  os.precision(precision);
+  if (stats.peak >= 0) os << " " << stats.peak << "K peak memory";
+  return os;
+}
+
+/**
+ * Function: findHierarchy
+ * -----------------------
+ * Returns where the cgroup v2 hierarchy is mounted: usually /sys/fs/cgroup,
+ * but /sys/fs/cgroup/unified on systems that still mount v1 hierarchies
+ * alongside it.  Returns the empty string if it isn't mounted at all.
+ */
+static string findHierarchy() {
+  ifstream mounts("/proc/self/mounts");
+  string device, mountPoint, type, rest;
+  while (mounts >> device >> mountPoint >> type && getline(mounts, rest)) {
+    if (type == "cgroup2") return mountPoint;
+  }
+
+  return "";
+}
+
+void enableCgroups() {
+  string hierarchy = findHierarchy();
+  ifstream self("/proc/self/cgroup");
+  string line, relative;
+  while (getline(self, line)) {
+    if (line.compare(0, 3, "0::") == 0) relative = line.substr(3); // the unified (v2) hierarchy
+  }
+
+  if (hierarchy.empty() || relative.empty()) throw STSHException("cgroups: No cgroup v2 hierarchy is mounted.");
+  string group = hierarchy + (relative == "/" ? "" : relative);
+  string shell = group + "/stsh-shell";
+  if (mkdir(shell.c_str(), 0755) < 0 && errno != EEXIST) throw STSHException(errorMessage(shell));
+  if (!writeFile(shell + "/cgroup.procs", to_string(getpid()))) throw STSHException(errorMessage(shell));
+
+  // a group with processes of its own can't hand controllers down, which is why the shell moved out
+  for (const char *controller: {"+cpu", "+memory", "+io"}) {
+    writeFile(group + "/cgroup.subtree_control", controller);
+  }
+
+  parent = group;
+}
+
+bool cgroupsEnabled() {
+  return !parent.empty();
+}
+
+string createJobCgroup(size_t num) {
+  string cgroup = parent + "/stsh-" + to_string(getpid()) + "-job-" + to_string(num);
+  if (mkdir(cgroup.c_str(), 0755) < 0 && errno != EEXIST) throw STSHException(errorMessage(cgroup));
+  return cgroup;
+}
+
+int openCgroupProcs(const string& cgroup) {
+  return open((cgroup + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+}
+
+void joinCgroup(int fd) {
+  ssize_t written = write(fd, "0", 1); // "0" names the writer
+  (void) written; // if it failed, the stage just runs uncontained
+}
+
+void removeJobCgroup(const string& cgroup) {
+  rmdir(cgroup.c_str());
+}
+
+static string limitFile(const string& cgroup, const string& resource) {
+  if (resource != "cpu" && resource != "memory" && resource != "io") {
+    throw STSHException("Unrecognized resource \"" + resource + "\" (expected cpu, memory, or io).");
+  }
+
+  return cgroup + "/" + resource + ".max";
+}
+
+void setCgroupLimit(const string& cgroup, const string& resource, const string& value) {
+  string path = limitFile(cgroup, resource);
+  if (!writeFile(path, value)) throw STSHException(errorMessage(path));
+}
+
+string getCgroupLimit(const string& cgroup, const string& resource) {
+  ifstream file(limitFile(cgroup, resource).c_str());
+  string limit, line;
+  while (getline(file, line)) limit += (limit.empty() ? "" : "; ") + line;
+  return file.eof() && !limit.empty() ? limit : "unavailable";
+}
+
+STSHCgroupStats readCgroupStats(const string& cgroup) {
+  STSHCgroupStats stats;
+  ifstream cpu((cgroup + "/cpu.stat").c_str());
+  string key;
+  long long value;
+  while (cpu >> key >> value) {
+    if (key == "usage_usec") stats.cpu = value / 1e6;
+  }
+
+  ifstream peak((cgroup + "/memory.peak").c_str());
+  if (peak >> value) stats.peak = value / 1024;
+  return stats;
+}
@@ -0,0 +1,115 @@
+/**
+ * File: stsh-cgroup.h
+ * -------------------
+ * Defines stsh's support for containing each job in a cgroup v2 control
+ * group of its own.  When enabled (with --cgroups), the shell moves itself
+ * into a leaf group named stsh-shell beneath the group it was started in,
+ * turns on the cpu, memory, and io controllers for that group's children
+ * (whichever of them have been delegated to us), and then gives every job
+ * a sibling group, stsh-<shell pid>-job-<job number>, that each of the job's
+ * processes joins before it execs.  The group is removed once the job has
+ * finished.
+ *
+ * Limits are applied to a running job with the limit builtin, which writes
+ * the job group's cpu.max, memory.max, and io.max, and the jobs listing
+ * reports what each job has used so far from cpu.stat and memory.peak.
+ */
+
+#pragma once
+#include <string>
+#include <iostream>
+
+/**
+ * Type: STSHCgroupStats
+ * ---------------------
+ * What a job's processes have used so far, as accounted by its group:
+ * CPU time in seconds (from cpu.stat), and peak memory in kilobytes (from
+ * memory.peak, or -1 if the memory controller isn't available).
+ */
+struct STSHCgroupStats {
+  double cpu;
+  long peak;
+
+  STSHCgroupStats() : cpu(0), peak(-1) {}
+};
+
+/**
+ * Function: operator<<
+ * --------------------
+ * Inserts the provided stats, as in "cgroup: 1.204s cpu 10240K peak memory".
+ */
+std::ostream& operator<<(std::ostream& os, const STSHCgroupStats& stats);
+
+/**
+ * Function: enableCgroups
+ * -----------------------
+ * Prepares the cgroup hierarchy as described above, so that every job
+ * created from now on gets a group of its own.  Throws an STSHException if
+ * there is no cgroup v2 hierarchy or the shell may not create groups in it.
+ * Controllers that can't be enabled are skipped, in which case the limits
+ * and stats that rely on them aren't available.
+ */
+void enableCgroups();
+
+/**
+ * Function: cgroupsEnabled
+ * ------------------------
+ * Returns true iff enableCgroups has succeeded.
+ */
+bool cgroupsEnabled();
+
+/**
+ * Function: createJobCgroup
+ * -------------------------
+ * Creates the group for the job with the provided number and returns its
+ * path.  Throws an STSHException if it can't be created.
+ */
+std::string createJobCgroup(size_t num);
+
+/**
+ * Function: openCgroupProcs
+ * -------------------------
+ * Returns a close-on-exec descriptor for the provided group's cgroup.procs
+ * file, which a child can hand to joinCgroup, or -1 if it can't be opened.
+ */
+int openCgroupProcs(const std::string& cgroup);
+
+/**
+ * Function: joinCgroup
+ * --------------------
+ * Moves the calling process into the group whose cgroup.procs is open as
+ * fd.  Only ever called in a freshly forked child, before it execs, so that
+ * everything it goes on to create is contained as well.
+ */
+void joinCgroup(int fd);
+
+/**
+ * Function: removeJobCgroup
+ * -------------------------
+ * Removes the provided job group, which should have no processes left.
+ */
+void removeJobCgroup(const std::string& cgroup);
+
+/**
+ * Function: setCgroupLimit
+ * ------------------------
+ * Writes value to the provided group's <resource>.max file, where resource
+ * is cpu, memory, or io.  Throws an STSHException if the resource isn't
+ * recognized or the kernel rejects the value.
+ */
+void setCgroupLimit(const std::string& cgroup, const std::string& resource, const std::string& value);
+
+/**
+ * Function: getCgroupLimit
+ * ------------------------
+ * Returns the contents of the provided group's <resource>.max file, with
+ * lines separated by "; ", or "unavailable" if it can't be read.
+ */
+std::string getCgroupLimit(const std::string& cgroup, const std::string& resource);
+
+/**
+ * Function: readCgroupStats
+ * -------------------------
+ * Returns what the processes in the provided group have used so far.
+ */
+STSHCgroupStats readCgroupStats(const std::string& cgroup);
@@ -0,0 +1,128 @@
+/**
+ * File: stsh-events.cc
+ * --------------------
+ * Presents the implementation of the STSHEventLoop class.
+ */
+
+#include "stsh-events.h"
+#include "stsh-exception.h"
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+using namespace std;
+
+static const int kMaxEpollEvents = 8;
+static const size_t kMaxSignalInfos = 16;
+
+STSHEventLoop::~STSHEventLoop() {
+  if (sigfd != -1) close(sigfd);
+  if (epfd != -1) close(epfd);
+  for (const pair<const int, pid_t>& child: children) close(child.first);
+}
+
+void STSHEventLoop::open(const sigset_t& signals, int inputfd) {
+  if (sigprocmask(SIG_BLOCK, &signals, NULL) < 0) {
+    throw STSHException("Failed to block signals for the event loop.");
+  }
+
+  sigfd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (sigfd < 0) throw STSHException("Failed to create signalfd: " + string(strerror(errno)) + ".");
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0) throw STSHException("Failed to create epoll set: " + string(strerror(errno)) + ".");
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = sigfd;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &event) < 0) {
+    throw STSHException("Failed to watch signalfd: " + string(strerror(errno)) + ".");
+  }
+
+  this->inputfd = inputfd;
+}
+
+void STSHEventLoop::watchInput(bool watch) {
+  if (watch == inputWatched || !inputPollable) return;
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = inputfd;
+  if (epoll_ctl(epfd, watch ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, inputfd, &event) < 0) {
+    if (errno != EPERM) throw STSHException("Failed to watch input: " + string(strerror(errno)) + ".");
+    inputPollable = false; // regular files and the like are always readable
+    return;
+  }
+
+  inputWatched = watch;
+}
+
+void STSHEventLoop::wait(vector<STSHEvent>& events, bool watchInput) {
+  this->watchInput(watchInput);
+  bool inputReady = watchInput && !inputPollable;
+  struct epoll_event ready[kMaxEpollEvents];
+  int count = 0;
+  while (true) {
+    count = epoll_wait(epfd, ready, kMaxEpollEvents, inputReady ? 0 : -1);
+    if (count >= 0 || errno != EINTR) break;
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (ready[i].data.fd == inputfd) {
+      inputReady = true;
+      continue;
+    }
+
+    if (ready[i].data.fd != sigfd) {
+      auto found = children.find(ready[i].data.fd);
+      if (found == children.end()) continue;
+      STSHEvent event = { kChildEvent, 0, found->second, found->first };
+      events.push_back(event);
+      continue;
+    }
+
+    struct signalfd_siginfo infos[kMaxSignalInfos];
+    while (true) {
+      ssize_t nread = read(sigfd, infos, sizeof(infos));
+      if (nread <= 0) break;
+      for (size_t j = 0; j < nread / sizeof(infos[0]); j++) {
+        STSHEvent event = { kSignalEvent, (int) infos[j].ssi_signo, 0, -1 };
+        events.push_back(event);
+      }
+    }
+  }
+
+  if (inputReady) {
+    STSHEvent event = { kInputEvent, 0, 0, -1 };
+    events.push_back(event);
+  }
+}
+
+bool STSHEventLoop::watchChild(pid_t pid) {
+#ifdef SYS_pidfd_open
+  int pidfd = syscall(SYS_pidfd_open, pid, 0);
+  if (pidfd < 0) return false;
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = pidfd;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, pidfd, &event) < 0) {
+    close(pidfd);
+    return false;
+  }
+
+  children[pidfd] = pid;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void STSHEventLoop::unwatchChild(int pidfd) {
+  if (children.erase(pidfd) == 0) return;
+  epoll_ctl(epfd, EPOLL_CTL_DEL, pidfd, NULL);
+  close(pidfd);
+}
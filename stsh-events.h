@@ -0,0 +1,125 @@
+/**
+ * File: stsh-events.h
+ * -------------------
+ * Defines the STSHEventLoop class, which lets stsh consume signals as
+ * ordinary events instead of through asynchronous signal handlers.
+ * The signals of interest are blocked and routed through a signalfd,
+ * which is multiplexed with terminal input in a single epoll set, so
+ * that all job bookkeeping runs in normal (non-handler) context and
+ * several pending signals can be handled as one batch.
+ *
+ * Typical usage:
+ *
+ *     sigset_t signals;
+ *     sigemptyset(&signals);
+ *     sigaddset(&signals, SIGCHLD);
+ *     STSHEventLoop loop;
+ *     loop.open(signals, STDIN_FILENO);
+ *     while (true) {
+ *       vector<STSHEvent> events;
+ *       loop.wait(events, true);
+ *       for (const STSHEvent& event: events) ...
+ *     }
+ */
+
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <signal.h>
+#include <sys/types.h>
+
+/**
+ * Enumerated Type: STSHEventType
+ * ------------------------------
+ * Identifies the kinds of events surfaced by an STSHEventLoop.
+ */
+enum STSHEventType { kSignalEvent, kInputEvent, kChildEvent };
+
+/**
+ * Type: STSHEvent
+ * ---------------
+ * A single event.  signal is only meaningful for kSignalEvents, and
+ * pid and pidfd are only meaningful for kChildEvents, which report
+ * that a watched child has exited and is ready to be reaped.
+ */
+struct STSHEvent {
+  STSHEventType type;
+  int signal;
+  pid_t pid;
+  int pidfd;
+};
+
+class STSHEventLoop {
+public:
+
+/**
+ * Constructor: STSHEventLoop
+ * --------------------------
+ * Constructs an event loop that isn't yet open.
+ */
+  STSHEventLoop() : sigfd(-1), epfd(-1), inputfd(-1), inputWatched(false), inputPollable(true) {}
+
+/**
+ * Destructor: ~STSHEventLoop
+ * --------------------------
+ * Closes the descriptors owned by the event loop.
+ */
+  ~STSHEventLoop();
+
+/**
+ * Method: open
+ * ------------
+ * Blocks the provided set of signals (so they are no longer delivered
+ * asynchronously), and prepares to surface them, along with readability
+ * of inputfd, as events.  Throws an STSHException if the signalfd or
+ * epoll set can't be created.
+ */
+  void open(const sigset_t& signals, int inputfd);
+
+/**
+ * Method: isOpen
+ * --------------
+ * Returns true iff open has been successfully called.
+ */
+  bool isOpen() const { return epfd != -1; }
+
+/**
+ * Method: wait
+ * ------------
+ * Blocks until at least one event is available, and then appends every
+ * available event to the provided vector.  Input readiness is only
+ * reported when watchInput is true, so the loop can wait on signals alone
+ * while a foreground job owns the terminal.
+ */
+  void wait(std::vector<STSHEvent>& events, bool watchInput);
+
+/**
+ * Method: watchChild
+ * ------------------
+ * Opens a pidfd for the specified child and adds it to the epoll set, so
+ * its exit is reported as a kChildEvent.  Returns false if the kernel
+ * doesn't support pidfds, in which case the caller should fall back to
+ * reaping children in response to SIGCHLD.
+ */
+  bool watchChild(pid_t pid);
+
+/**
+ * Method: unwatchChild
+ * --------------------
+ * Removes the provided pidfd (as surfaced by a kChildEvent) from the
+ * epoll set and closes it.  Should be called once the child is reaped.
+ */
+  void unwatchChild(int pidfd);
+
+private:
+  int sigfd;
+  int epfd;
+  int inputfd;
+  bool inputWatched;  // true iff inputfd is currently in the epoll set
+  bool inputPollable; // false if inputfd is something like a regular file, which epoll rejects
+  std::unordered_map<int, pid_t> children; // maps each watched pidfd to its child's pid
+
+  void watchInput(bool watch);
+  STSHEventLoop(const STSHEventLoop& original) = delete;
+  STSHEventLoop& operator=(const STSHEventLoop& rhs) = delete;
+};
@@ -6,6 +6,7 @@
 
 #include "stsh-job-list.h"
 #include "stsh-exception.h"
+#include "stsh-cgroup.h"
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -14,24 +15,34 @@ using namespace std;
 STSHJob STSHJobList::njob; // njob stands for no-job
 
 STSHJob& STSHJobList::addJob(const STSHJobState& state) {
-  jobs[next] = STSHJob(next, state);
-  return jobs[next++];
+  jobs[next] = STSHJob(next, kBackground);
+  STSHJob& job = jobs[next++];
+  setState(job, state);
+  return job;
 }
 
-bool STSHJobList::hasForegroundJob() const {
-  const STSHJob& job = getForegroundJob();
-  return &job != &njob;
+void STSHJobList::addProcess(STSHJob& job, const STSHProcess& process) {
+  job.addProcess(process);
+  pids[process.getID()] = job.getNum();
 }
 
-STSHJob& STSHJobList::getForegroundJob() {
-  for (pair<const size_t, STSHJob>& p: jobs) {
-    STSHJob& job = p.second;
-    if (job.getState() == kForeground) {
-      return job;
-    }
+void STSHJobList::setState(STSHJob& job, STSHJobState state) {
+  if (state == kForeground) {
+    if (foreground != 0 && foreground != job.getNum()) getJob(foreground).setState(kBackground);
+    foreground = job.getNum();
+  } else if (foreground == job.getNum()) {
+    foreground = 0;
   }
 
-  return njob;
+  job.setState(state);
+}
+
+bool STSHJobList::hasForegroundJob() const {
+  return foreground != 0;
+}
+
+STSHJob& STSHJobList::getForegroundJob() {
+  return getJob(foreground);
 }
 
 const STSHJob& STSHJobList::getForegroundJob() const { 
@@ -52,19 +63,13 @@ const STSHJob& STSHJobList::getJob(size_t num) const {
 }
 
 bool STSHJobList::containsProcess(pid_t pid) const {
-  const STSHJob& job = getJobWithProcess(pid);
-  return &job != &njob;
+  return pids.find(pid) != pids.cend();
 }
 
 STSHJob& STSHJobList::getJobWithProcess(pid_t pid) {
-  for (pair<const size_t, STSHJob>& p: jobs) {
-    STSHJob& job = p.second;    
-    if (job.containsProcess(pid)) {
-      return job;
-    }
-  }
-  
-  return njob;
+  auto found = pids.find(pid);
+  if (found == pids.end()) return njob;
+  return getJob(found->second);
 }
 
 const STSHJob& STSHJobList::getJobWithProcess(pid_t pid) const {
@@ -81,8 +86,9 @@ void STSHJobList::synchronize(STSHJob& job) {
     }
   }
   
+  bool wasForeground = job.getState() == kForeground;
   if (!somethingIsRunning) {
-    job.setState(kBackground); // make sure it's not categorized as foreground
+    setState(job, kBackground); // make sure it's not categorized as foreground
   }
   
   for (const STSHProcess& process: processes) {
@@ -91,9 +97,35 @@ void STSHJobList::synchronize(STSHJob& job) {
     }
   }
   
+  for (const STSHProcess& process: processes) {
+    auto found = pids.find(process.getID());
+    if (found != pids.end() && found->second == job.getNum()) { // the pid may have been reused by a newer job since
+      pids.erase(found);
+    }
+  }
+
+  if (!job.getCgroup().empty()) removeJobCgroup(job.getCgroup());
+  if (wasForeground) foregroundStatus = processes.empty() ? 0 : processes.back().getExitStatus();
+  if (!processes.empty()) {
+    if (finished.size() == kFinishedJobsRetained) finished.pop_front();
+    finished.push_back(job);
+  }
+  
   jobs.erase(job.getNum());
 }
 
+bool STSHJobList::containsFinishedJob(size_t num) const {
+  return &getFinishedJob(num) != &njob;
+}
+
+const STSHJob& STSHJobList::getFinishedJob(size_t num) const {
+  for (const STSHJob& job: finished) {
+    if (job.getNum() == num) return job;
+  }
+
+  return njob;
+}
+
 ostream& operator<<(ostream& os, const STSHJobList& joblist) {
   for (const pair<size_t, STSHJob>& p: joblist.jobs) 
     os << p.second << endl;
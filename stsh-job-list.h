@@ -9,7 +9,7 @@
  * static void addToJobList(STSHJobList& jobList, const vector<pair<pid_t, command>>& children) {
  *   STSHJob& job = jobList.addJob(kBackground); //
  *   for (const pair<pid_t, command>& child: children) {
- *      job.addProcess(STSHProcess(child.first, child.second)); // third argument defaults to kRunning
+ *      jobList.addProcess(job, STSHProcess(child.first, child.second)); // third argument defaults to kRunning
  *   }
  *   cout << jobList;
  * }
@@ -33,6 +33,8 @@
 #include <cstddef>
 #include <string>
 #include <map>
+#include <deque>
+#include <unordered_map>
 #include <iostream>
 #include <sys/types.h>
 
@@ -58,11 +60,33 @@ public:
  */
   STSHJob& addJob(const STSHJobState& state);
 
+/**
+ * Method: addProcess
+ * ------------------
+ * Appends the provided process to the provided job (which must belong to
+ * the receiving STSHJobList) and indexes it by pid, so that containsProcess
+ * and getJobWithProcess can find it in constant time.  Processes should
+ * be added through this method rather than STSHJob::addProcess.
+ */
+  void addProcess(STSHJob& job, const STSHProcess& process);
+
+/**
+ * Method: setState
+ * ----------------
+ * Sets the state of the provided job (which must belong to the receiving
+ * STSHJobList) and keeps track of which job, if any, is in the foreground.
+ * Promoting a job to the foreground demotes whichever job was there before,
+ * since there can be at most one.  Job states should be changed through
+ * this method rather than STSHJob::setState.
+ */
+  void setState(STSHJob& job, STSHJobState state);
+
 /**
  * Method: hasForegroundJob
  * ------------------------
  * Returns true if and only if the receiving STSHJobList has
  * a foreground job (of course, there can be at most one.)
+ * Runs in constant time.
  */
   bool hasForegroundJob() const;
 
@@ -72,7 +96,7 @@ public:
  * Returns a reference to the foreground job. Typically, a call
  * this method should be guarded by a call to hasForegroundJob.
  * If this method is called when hasForegroundJob would have returned
- * false, the behavior is undefined.
+ * false, the behavior is undefined.  Runs in constant time.
  */  
   STSHJob& getForegroundJob();
   const STSHJob& getForegroundJob() const;
@@ -99,6 +123,7 @@ public:
  * -----------------------
  * Returns true iff some process within some
  * job within the job list has the specified pid.
+ * Runs in constant time.
  */
   bool containsProcess(pid_t pid) const;
 
@@ -109,7 +134,7 @@ public:
  * identified by the specified pid.  Calls to this function
  * should be guarded by calls to containsProcess, because
  * when the specified pid doesn't exist, the behavior here
- * isn't defined.
+ * isn't defined.  Runs in constant time.
  */
   STSHJob& getJobWithProcess(pid_t pid);
   const STSHJob& getJobWithProcess(pid_t pid) const;
@@ -125,9 +150,37 @@ public:
  * a foreground job).
  */  
   void synchronize(STSHJob& job);
+
+/**
+ * Method: containsFinishedJob, getFinishedJob, getFinishedJobs
+ * ------------------------------------------------------------
+ * Jobs removed by synchronize because every one of their processes has
+ * terminated are retained (the most recent kFinishedJobsRetained of them,
+ * oldest first), so their resource usage can still be reported.  getFinishedJob
+ * returns an empty job if the specified one isn't retained.
+ */
+  bool containsFinishedJob(size_t num) const;
+  const STSHJob& getFinishedJob(size_t num) const;
+  const std::deque<STSHJob>& getFinishedJobs() const { return finished; }
+
+  static const size_t kFinishedJobsRetained = 16;
+
+/**
+ * Method: getForegroundStatus
+ * ---------------------------
+ * Returns the exit status of the last stage of the most recent foreground
+ * job to finish (0 if it had no processes, or if none has finished yet).
+ * It's recorded by synchronize as the job finishes, so it's available even
+ * once the job itself is no longer retained.
+ */
+  int getForegroundStatus() const { return foregroundStatus; }
   
 private:
   size_t next = 1;
+  size_t foreground = 0; // number of the foreground job, or 0 if there isn't one
+  int foregroundStatus = 0; // exit status of the most recent foreground job to finish
   std::map<size_t, STSHJob> jobs; // maps work, because we want to publish in order of job number
+  std::unordered_map<pid_t, size_t> pids; // maps the pid of every listed process to its job number
+  std::deque<STSHJob> finished; // recently finished jobs, oldest first
   static STSHJob njob;
 };
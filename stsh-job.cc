@@ -5,8 +5,10 @@
  */
 
 #include "stsh-job.h"
+#include "stsh-cgroup.h"
 #include <iomanip> // for setw
 #include <sstream> // for ostringstream
+#include <algorithm> // for max
 using namespace std;
 
 STSHProcess STSHJob::nprocess;
@@ -30,6 +32,39 @@ const STSHProcess& STSHJob::getProcess(pid_t pid) const {
   return const_cast<STSHJob *>(this)->getProcess(pid);
 }
 
+STSHUsage STSHJob::getUsage() const {
+  STSHUsage total;
+  if (processes.empty()) return total;
+  timespec first = processes[0].getStartTime(), last = first;
+  bool running = false;
+  for (const STSHProcess& process: processes) {
+    STSHUsage usage = process.getUsage();
+    total.user += usage.user;
+    total.system += usage.system;
+    total.maxrss = max(total.maxrss, usage.maxrss);
+    if (secondsBetween(process.getStartTime(), first) > 0) first = process.getStartTime();
+    if (!process.hasExited()) {
+      running = true;
+    } else if (secondsBetween(last, process.getEndTime()) > 0) {
+      last = process.getEndTime();
+    }
+  }
+
+  if (running) clock_gettime(CLOCK_MONOTONIC, &last);
+  total.real = secondsBetween(first, last);
+  return total;
+}
+
+void reportUsage(ostream& os, const STSHJob& job) {
+  const vector<STSHProcess>& processes = job.getProcesses();
+  os << "[" << job.getNum() << "] " << job.getUsage() << endl;
+  for (size_t i = 0; i < processes.size(); i++) {
+    os << setw(5) << i << ": " << processes[i].getUsage() << " ";
+    for (const string& token: processes[i].getTokens()) os << " " << token;
+    os << endl;
+  }
+}
+
 ostream& operator<<(ostream& os, const STSHJob& job) {
   ostringstream oss;
   oss << "[" << job.num << "]";
@@ -41,5 +76,9 @@ ostream& operator<<(ostream& os, const STSHJob& job) {
     os << setw(oss.str().size()) << " " << " " << job.processes[i];
   }
 
+  if (!job.cgroup.empty()) {
+    os << endl << setw(oss.str().size()) << " " << " " << readCgroupStats(job.cgroup);
+  }
+
   return os;
 }
@@ -25,6 +25,7 @@
 #include <cstddef>  // for size_t
 #include <vector>   // for vector
 #include <iostream> // for ostream
+#include <string>   // for string
 
 /**
  * Enumerated Type: STSHJobState
@@ -37,6 +38,15 @@
  */
 enum STSHJobState { kForeground, kBackground };
 
+/**
+ * Enumerated Type: STSHJobPriority
+ * --------------------------------
+ * Records whose scheduling settings (see stsh-priority.h) a job runs with:
+ * the shell's own, the demotion imposed on background jobs, or settings
+ * given on its command line, which the shell then leaves alone.
+ */
+enum STSHJobPriority { kInteractivePriority, kDemotedPriority, kExplicitPriority };
+
 class STSHJob {
 
 /**
@@ -63,7 +73,7 @@ public:
  * --------------------
  * Constructs an instance of STSHJob with the specified job number and state.
  */
-  STSHJob(size_t num, STSHJobState state) : num(num), state(state) {}
+  STSHJob(size_t num, STSHJobState state) : num(num), state(state), priority(kInteractivePriority) {}
 
 /**
  * Method: STSHJob
@@ -116,6 +126,8 @@ public:
  * Method: setState
  * ----------------
  * Sets the job state (which must be either kForeground or kBackground).
+ * Jobs held by an STSHJobList should have their state changed via
+ * STSHJobList::setState, so the list knows which job is in the foreground.
  */
   void setState(STSHJobState state) { this->state = state; }
 
@@ -127,9 +139,47 @@ public:
  */
   pid_t getGroupID() const { return processes.empty() ? 0 : processes[0].getID(); }
 
+/**
+ * Method: getUsage
+ * ----------------
+ * Aggregates the resource usage of every process in the job: CPU times are
+ * summed, the peak resident set size is the largest of any one process, and
+ * the real time runs from the first launch to the last exit (or to now, if
+ * some process hasn't exited yet).
+ */
+  STSHUsage getUsage() const;
+
+/**
+ * Methods: getCgroup, setCgroup
+ * -----------------------------
+ * Get and set the path of the job's control group (see stsh-cgroup.h), which
+ * is empty unless jobs are being contained.
+ */
+  const std::string& getCgroup() const { return cgroup; }
+  void setCgroup(const std::string& cgroup) { this->cgroup = cgroup; }
+
+/**
+ * Methods: getPriority, setPriority
+ * ---------------------------------
+ * Get and set whose scheduling settings the job is running with.
+ */
+  STSHJobPriority getPriority() const { return priority; }
+  void setPriority(STSHJobPriority priority) { this->priority = priority; }
+
 private:
   size_t num;
   std::vector<STSHProcess> processes;
   STSHJobState state;
+  std::string cgroup;
+  STSHJobPriority priority;
   static STSHProcess nprocess;
 };
+
+/**
+ * Function: reportUsage
+ * ---------------------
+ * Inserts a time-style report of the provided job's resource usage into the
+ * provided ostream: one line for the job as a whole, followed by one line for
+ * each stage of its pipeline, so the stage that's the bottleneck stands out.
+ */
+void reportUsage(std::ostream& os, const STSHJob& job);
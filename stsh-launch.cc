@@ -0,0 +1,238 @@
+/**
+ * File: stsh-launch.cc
+ * --------------------
+ * Presents the implementation of the two launch engines described
+ * in stsh-launch.h.
+ */
+
+#include "stsh-launch.h"
+#include "stsh-exception.h"
+#include "stsh-splice.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/mman.h> // for memfd_create
+using namespace std;
+
+extern char **environ;
+
+static STSHLaunchMode launchMode = kLaunchFork;
+
+void setLaunchMode(STSHLaunchMode mode) {
+  launchMode = mode;
+}
+
+STSHLaunchMode getLaunchMode() {
+  return launchMode;
+}
+
+STSHLaunchMode parseLaunchMode(const string& name) {
+  if (name == "fork") return kLaunchFork;
+  if (name == "spawn") return kLaunchSpawn;
+  throw STSHException("Unrecognized launch mode \"" + name + "\" (expected fork or spawn).");
+}
+
+/**
+ * Function: outputFlags
+ * ---------------------
+ * Returns the flags output files are opened with: created if need be, and
+ * either truncated or appended to, all in a single open call.
+ */
+static int outputFlags(bool append) {
+  return O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
+}
+
+/**
+ * Function: redirect
+ * ------------------
+ * Opens the named file and moves it to fd, from within a forked child.  If
+ * the file can't be opened, the child reports why and exits.
+ */
+static void redirect(const string& file, int flags, int fd) {
+  int opened = open(file.c_str(), flags | O_CLOEXEC, 0644); // dup2 clears O_CLOEXEC on fd itself
+  if (opened < 0) {
+    cerr << file << ": " << strerror(errno) << endl;
+    _exit(1);
+  }
+
+  dup2(opened, fd);
+  close(opened);
+}
+
+static pid_t launchWithFork(const STSHStage& stage) {
+  bool builtin = isBuiltinStage(*stage.cmd);
+  string path = stage.paths == NULL || builtin ? "" : stage.paths->resolve(stage.cmd->command);
+  if (!path.empty() && access(path.c_str(), X_OK) < 0 && stage.paths->forget(stage.cmd->command)) {
+    path = stage.paths->resolve(stage.cmd->command); // cached path is stale, so search again, here rather than in every child
+  }
+
+  pid_t pid = fork();
+  if (pid != 0) return pid;
+
+  setpgid(0, stage.pgid);
+  if (stage.foreground) tcsetpgrp(STDIN_FILENO, getpgid(0));
+  sigset_t empty;
+  sigemptyset(&empty);
+  sigprocmask(SIG_SETMASK, &empty, NULL);
+  if (stage.placement != NULL) applyPlacement(*stage.placement);
+  if (stage.cgroupfd != -1) joinCgroup(stage.cgroupfd);
+  if (stage.priority != NULL) applyPriority(*stage.priority);
+
+  if (!stage.input.empty()) {
+    redirect(stage.input, O_RDONLY, STDIN_FILENO);
+  } else if (stage.infd != -1) {
+    dup2(stage.infd, STDIN_FILENO);
+  }
+
+  if (!stage.output.empty()) {
+    redirect(stage.output, outputFlags(stage.append), STDOUT_FILENO);
+  } else if (stage.outfd != -1) {
+    dup2(stage.outfd, STDOUT_FILENO);
+  }
+
+  if (!stage.error.empty()) {
+    redirect(stage.error, outputFlags(false), STDERR_FILENO);
+  } else if (stage.errorToOutput) {
+    dup2(STDOUT_FILENO, STDERR_FILENO);
+  }
+
+  if (builtin) _exit(runBuiltinStage(*stage.cmd));
+  if (!path.empty()) execv(path.c_str(), stage.cmd->argv());
+  execvp(stage.cmd->command, stage.cmd->argv()); // no cached path, or the cached one has gone stale
+  cerr << stage.cmd->command << ": Command not found." << endl;
+  _exit(127); // as other shells do; _exit, so stdio buffers inherited from the shell aren't flushed twice
+}
+
+/**
+ * Function: canRedirect
+ * ---------------------
+ * Returns true iff file can be opened for reading (mode R_OK) or writing
+ * (mode W_OK): it exists and allows it, or, for writing, it doesn't exist
+ * yet but its directory allows it to be created.
+ */
+static bool canRedirect(const string& file, int mode) {
+  if (access(file.c_str(), mode) == 0) return true;
+  if (mode != W_OK || errno != ENOENT) return false;
+  size_t slash = file.rfind('/');
+  string dir = slash == string::npos ? "." : slash == 0 ? "/" : file.substr(0, slash);
+  return access(dir.c_str(), W_OK | X_OK) == 0;
+}
+
+static pid_t launchWithSpawn(const STSHStage& stage) {
+  if ((!stage.input.empty() && !canRedirect(stage.input, R_OK)) ||
+      (!stage.output.empty() && !canRedirect(stage.output, W_OK)) ||
+      (!stage.error.empty() && !canRedirect(stage.error, W_OK))) {
+    return launchWithFork(stage); // whose child reports the failure (and exits) just as it always does
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  if (!stage.input.empty()) {
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, stage.input.c_str(), O_RDONLY, 0);
+  } else if (stage.infd != -1) {
+    posix_spawn_file_actions_adddup2(&actions, stage.infd, STDIN_FILENO);
+  }
+
+  if (!stage.output.empty()) {
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, stage.output.c_str(), outputFlags(stage.append), 0644);
+  } else if (stage.outfd != -1) {
+    posix_spawn_file_actions_adddup2(&actions, stage.outfd, STDOUT_FILENO);
+  }
+
+  if (!stage.error.empty()) {
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, stage.error.c_str(), outputFlags(false), 0644);
+  } else if (stage.errorToOutput) {
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+  }
+
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  short flags = POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK;
+#ifdef POSIX_SPAWN_TCSETPGROUP
+  if (stage.foreground && isatty(STDIN_FILENO)) {
+    flags |= POSIX_SPAWN_TCSETPGROUP; // child takes the terminal before it execs
+    posix_spawnattr_tcsetpgrp_np(&attr, STDIN_FILENO);
+  }
+#endif
+  posix_spawnattr_setflags(&attr, flags);
+  posix_spawnattr_setpgroup(&attr, stage.pgid);
+  sigset_t empty;
+  sigemptyset(&empty);
+  posix_spawnattr_setsigmask(&attr, &empty);
+
+  pid_t pid;
+  int err;
+  if (stage.paths == NULL) {
+    err = posix_spawnp(&pid, stage.cmd->command, &actions, &attr, stage.cmd->argv(), environ);
+  } else {
+    string path = stage.paths->resolve(stage.cmd->command);
+    err = path.empty() ? ENOENT : posix_spawn(&pid, path.c_str(), &actions, &attr, stage.cmd->argv(), environ);
+    if (err == ENOENT && access(path.c_str(), X_OK) < 0 && stage.paths->forget(stage.cmd->command)) { // cached path is stale, so search again
+      path = stage.paths->resolve(stage.cmd->command);
+      err = path.empty() ? ENOENT : posix_spawn(&pid, path.c_str(), &actions, &attr, stage.cmd->argv(), environ);
+    }
+  }
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  if (err == ENOENT) {
+    throw STSHException(string(stage.cmd->command) + ": Command not found.");
+  } else if (err != 0) {
+    throw STSHException(string(stage.cmd->command) + ": " + strerror(err) + ".");
+  }
+
+  return pid;
+}
+
+pid_t launchProcess(const STSHStage& stage) {
+  bool forkOnly = stage.placement != NULL || stage.cgroupfd != -1 || stage.priority != NULL || isBuiltinStage(*stage.cmd);
+  if (launchMode == kLaunchSpawn && !forkOnly) return launchWithSpawn(stage);
+  return launchWithFork(stage); // the others need a child that can run our code before it execs
+}
+
+/**
+ * Function: getMaxPipeSize
+ * ------------------------
+ * Returns the largest capacity an unprivileged process may give a pipe,
+ * as read (once) from /proc/sys/fs/pipe-max-size.
+ */
+static size_t getMaxPipeSize() {
+  static size_t maxPipeSize = 0;
+  if (maxPipeSize == 0) {
+    ifstream limit("/proc/sys/fs/pipe-max-size");
+    if (!(limit >> maxPipeSize) || maxPipeSize == 0) maxPipeSize = 1 << 20; // the kernel's default limit
+  }
+
+  return maxPipeSize;
+}
+
+size_t resizePipe(int fd, size_t capacity) {
+  int result = fcntl(fd, F_SETPIPE_SZ, (int) min(capacity, getMaxPipeSize()));
+  return result < 0 ? fcntl(fd, F_GETPIPE_SZ) : result;
+}
+
+int openHereString(const string& word) {
+  string text = word;
+  if (text.size() >= 2 && text[0] == '"' && text[text.size() - 1] == '"') text = text.substr(1, text.size() - 2);
+  text += '\n';
+  int fd = memfd_create("stsh-here-string", MFD_CLOEXEC);
+  if (fd < 0) throw STSHException(string("Failed to create here-string: ") + strerror(errno) + ".");
+  for (size_t written = 0; written < text.size(); ) {
+    ssize_t count = write(fd, text.data() + written, text.size() - written);
+    if (count < 0) {
+      close(fd);
+      throw STSHException(string("Failed to create here-string: ") + strerror(errno) + ".");
+    }
+
+    written += count;
+  }
+
+  lseek(fd, 0, SEEK_SET);
+  return fd;
+}
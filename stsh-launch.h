@@ -0,0 +1,132 @@
+/**
+ * File: stsh-launch.h
+ * -------------------
+ * Defines the launchProcess function, which knows how to start a single
+ * stage of a pipeline as a new process, and the STSHLaunchMode type used to
+ * select which of the two launch engines does the work:
+ *
+ *   kLaunchFork:  the traditional fork followed by execvp.  fork duplicates
+ *                 the shell's page tables, so its cost grows with the size of
+ *                 the shell's resident heap.
+ *   kLaunchSpawn: posix_spawnp, which glibc implements via a vfork-style clone
+ *                 that shares the shell's address space until the exec, so
+ *                 launch latency stays flat regardless of how large the shell
+ *                 has grown.
+ *
+ * Both engines place the new process in the requested process group and wire
+ * up its standard input and output exactly the same way, so job control
+ * (STSHJob::getGroupID, tcsetpgrp, kill(-pgid, sig)) behaves identically.
+ *
+ * Builtin data-movement stages (see stsh-splice.h) are always forked, since
+ * the child runs the stage itself instead of exec'ing anything.  So are
+ * stages with a placement (see stsh-placement.h), a control group (see
+ * stsh-cgroup.h) to join, or scheduling settings (see stsh-priority.h), since
+ * posix_spawn has no way to set a CPU affinity, memory policy, nice value, or
+ * I/O priority, or to start the new process in a different group.
+ */
+
+#pragma once
+#include "stsh-parser/stsh-parse.h"
+#include "stsh-path-cache.h"
+#include "stsh-placement.h"
+#include "stsh-cgroup.h"
+#include "stsh-priority.h"
+#include <string>
+#include <sys/types.h>
+
+/**
+ * Enumerated Type: STSHLaunchMode
+ * -------------------------------
+ * Identifies the launch engine used to start new processes.
+ */
+enum STSHLaunchMode { kLaunchFork, kLaunchSpawn };
+
+/**
+ * Type: STSHStage
+ * ---------------
+ * Describes everything needed to launch one stage of a pipeline.
+ */
+struct STSHStage {
+  const command *cmd;   // the command to be executed
+  pid_t pgid;           // process group to join, or 0 if the new process should lead its own
+  bool foreground;      // true iff the process group should be handed the terminal
+  int infd;             // descriptor to become standard input, or -1 to inherit the shell's
+  int outfd;            // descriptor to become standard output, or -1 to inherit the shell's
+  std::string input;    // file to redirect standard input from (empty if none)
+  std::string output;   // file to redirect standard output to (empty if none)
+  bool append;          // true iff output should be appended to rather than truncated
+  std::string error;    // file to redirect standard error to (empty if none)
+  bool errorToOutput;   // true iff standard error should go wherever standard output (or outfd) goes
+  STSHPathCache *paths; // where to look the command up, or NULL to leave the $PATH search to exec
+  const STSHStagePlacement *placement; // where to run the command, or NULL to run wherever the shell may
+  int cgroupfd;         // the cgroup.procs file of the control group to join, or -1 to stay in the shell's
+  const STSHPriority *priority; // scheduling settings to run the command with, or NULL for the shell's own
+
+  STSHStage() : cmd(NULL), pgid(0), foreground(false), infd(-1), outfd(-1), append(false),
+                errorToOutput(false), paths(NULL), placement(NULL), cgroupfd(-1), priority(NULL) {}
+};
+
+/**
+ * Function: setLaunchMode
+ * -----------------------
+ * Selects the engine used by all subsequent calls to launchProcess.  The
+ * default is kLaunchFork.
+ */
+void setLaunchMode(STSHLaunchMode mode);
+
+/**
+ * Function: getLaunchMode
+ * -----------------------
+ * Returns the engine currently used by launchProcess.
+ */
+STSHLaunchMode getLaunchMode();
+
+/**
+ * Function: parseLaunchMode
+ * -------------------------
+ * Converts "fork" or "spawn" to the corresponding STSHLaunchMode, throwing an
+ * STSHException if the name isn't recognized.
+ */
+STSHLaunchMode parseLaunchMode(const std::string& name);
+
+/**
+ * Function: launchProcess
+ * -----------------------
+ * Launches the provided stage and returns the pid of the new process.  The
+ * new process starts with an empty signal mask, regardless of which signals
+ * the shell has blocked at the time of the call.
+ *
+ * When the stage has a path cache, the command is looked up in the shell
+ * and executed by absolute path.  If the cached path no longer exists, both
+ * engines discard it and search again.
+ *
+ * If the spawn engine can't start the command, an STSHException is thrown
+ * from within the shell.  The fork engine can only discover the failure in the
+ * child, which reports it on stderr and exits.  A redirection that can't be
+ * opened is reported by the child under either engine (the spawn engine
+ * checks for one up front, and forks instead if it finds one), so it reads
+ * the same, and the stage exits with status 1, whichever engine is selected.
+ */
+pid_t launchProcess(const STSHStage& stage);
+
+/**
+ * Function: resizePipe
+ * --------------------
+ * Asks for the pipe with the provided descriptor to be able to hold capacity
+ * bytes (via F_SETPIPE_SZ), clamped to /proc/sys/fs/pipe-max-size, and
+ * returns the capacity the kernel actually settled on, which may be rounded
+ * up to a power of two number of pages.  Larger pipes let adjacent stages of
+ * a high-throughput pipeline run longer between context switches.
+ */
+size_t resizePipe(int fd, size_t capacity);
+
+/**
+ * Function: openHereString
+ * ------------------------
+ * Returns a close-on-exec descriptor from which the provided here-string
+ * (less any surrounding double quotes), followed by a newline, can be read,
+ * for use as a stage's infd.  The text lives in an anonymous memory-backed
+ * file, so it can be any length without the shell having to feed it through
+ * a pipe.  Throws an STSHException if the file can't be created.
+ */
+int openHereString(const std::string& word);
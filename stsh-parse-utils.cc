@@ -1,11 +1,12 @@
 /**
  * File: stsh-parse-utils.cc
  * -------------------------
- * Provides the implementation of parseNumber.
+ * Provides the implementations of parseNumber and parseSize.
  */
 
 #include "stsh-parse-utils.h"
 #include "stsh-exception.h"
+#include "stsh-parser/stsh-size.h" // for parse_size
 #include <cstdlib>
 using namespace std;
 
@@ -16,3 +17,9 @@ size_t parseNumber(const char *arg, const string& usage) {
   if (*end != '\0' || num < 0) throw STSHException(usage);
   return num;
 }
+
+size_t parseSize(const char *arg, const string& usage) {
+  size_t size;
+  if (arg == NULL || !parse_size(arg, size)) throw STSHException(usage);
+  return size;
+}
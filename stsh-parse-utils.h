@@ -1,7 +1,7 @@
 /**
  * File: stsh-parse-utils.h
  * ------------------------
- * Defines a single function that's helpful for converting
+ * Defines functions that are helpful for converting
  * numeric strings to actual numbers.
  */
 
@@ -16,3 +16,11 @@
  * converts it to a size_t, and returns it.
  */
 size_t parseNumber(const char *arg, const std::string& usage);
+
+/**
+ * Function: parseSize
+ * -------------------
+ * Accepts the provided string (assumed to be a size in bytes, optionally
+ * followed by K, M, or G), converts it to a size_t, and returns it.
+ */
+size_t parseSize(const char *arg, const std::string& usage);
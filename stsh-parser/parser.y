@@ -8,37 +8,72 @@
 
 %defines "parser.h"
 
+%code requires {
+#include "stsh-parse.h" // for command and arena_list, which appear in the %union
+
+/**
+ * Each stage of a pipeline summarizes the redirections it contains as a
+ * bitwise combination of these flags, so the rules below can reject a
+ * redirection that appears twice, or in a stage where it isn't allowed.
+ */
+enum { kRedirectsInput = 1, kRedirectsOutput = 2, kRedirectsError = 4 };
+
+struct parsed_redirections {
+  unsigned flags;
+  char *error;        // the file named by 2>, if any
+  bool errorToOutput; // true iff 2>&1 or &> appeared
+};
+
+struct parsed_stage {
+  struct command cmd;
+  unsigned redirections;
+};
+
+struct parsed_stages {
+  arena_list<command> list;
+  unsigned last; // the redirections in the last stage parsed so far
+};
+}
+
 %{
 #include <vector>
 #include "stsh-parse.h"
    
-#include <cstring>     // for strncpy
 #include <iostream>    // for cout, endl
    
 extern int yylex();
 void yyerror(pipeline& finalPipeLine, const char *s) { std::cerr << "ERROR: " << s << std::endl; }
+#define SYNTAX_ERROR_IF(condition) if (condition) { yyerror(finalPipeLine, "syntax error"); YYERROR; }
 %}
 
+%code {
+static parsed_redirections redirection(unsigned flags, char *error = NULL, bool errorToOutput = false) {
+  parsed_redirections r = { flags, error, errorToOutput };
+  return r;
+}
+}
+
 %parse-param {pipeline &finalPipeLine}
 
 %union {
-  struct pipeline *pipeline;
   struct command cmd;
   char *word;
-  std::vector<command> *cmd_list;
-  std::vector<char *> *arg_list;
+  parsed_stage stage;
+  parsed_stages stages;
+  arena_list<char *> arg_list;
+  parsed_redirections redirections;
   int token;
   bool background;
 }
 
 %token <word> WORD
-%token <token> LT GT PIPE
+%token <token> LT GT PIPE APPEND ERR_GT ERR_TO_OUT AMP_GT HERE
 %token <background> AMPERSAND
 
-%type <pipeline> input in_out_cmd
-%type <cmd_list> cmd_list
-%type <word> in_redir out_redir
-%type <cmd> cmd in_cmd out_cmd
+%type <stages> stages
+%type <stage> stage
+%type <redirections> redirs redir
+%type <cmd> cmd
 %type <arg_list> arg_list
 %type <background> background
 
@@ -48,65 +83,76 @@ void yyerror(pipeline& finalPipeLine, const char *s) { std::cerr << "ERROR: " <<
 
 
 input:     /* empty */                            {  /* empty input, don't modify finalPipeLine */ }
-          |  in_out_cmd background                {  /* work is done in internal nodes */ }
-          |  in_cmd PIPE cmd_list out_cmd background {  $$ = &finalPipeLine;
-                                                     $$->commands.push_back($1); 
-                                                     $$->commands.insert($$->commands.end(), $3->begin(), $3->end()); delete $3;
-                                                     $$->commands.push_back($4);
+          |  stages background                    {  command_list& commands = finalPipeLine.commands;
+                                                     commands.count = $1.list.count;
+                                                     commands.elems = finalPipeLine.storage.allocate<command>(commands.count);
+                                                     size_t i = 0;
+                                                     for (arena_list<command>::node *n = $1.list.head; n != NULL; n = n->next) {
+                                                       commands.elems[i++] = n->value;
+                                                     }
                                                   }
 ;
 
 background:  /* empty */            { finalPipeLine.background = false; }
           |  background AMPERSAND   { finalPipeLine.background = true; }
 
-cmd_list:    /* empty */            { $$ = new std::vector<command>(); }
-          |  cmd_list cmd PIPE      { $$ = $1; $$->push_back($2); }
-;
-
-in_cmd:      in_redir cmd           { $$ = $2; /* infile handled in internal node */ }
-          |  cmd in_redir           { $$ = $1; /* infile handled in internal node */ }
-          |  cmd                    { $$ = $1; }
-;
-
-out_cmd:     out_redir cmd          { $$ = $2; /* outfile handled in internal node */ }
-          |  cmd out_redir          { $$ = $1; /* outfile handled in internal node */ }
-          |  cmd                    { $$ = $1; }
+/* input redirection only in the first stage, output redirection only in the last */
+stages:      stage                  { $$.list.clear(); $$.list.append(finalPipeLine.storage, $1.cmd); $$.last = $1.redirections; }
+          |  stages PIPE stage      { SYNTAX_ERROR_IF(($1.last & kRedirectsOutput) || ($3.redirections & kRedirectsInput));
+                                      $$ = $1;
+                                      $$.list.append(finalPipeLine.storage, $3.cmd);
+                                      $$.last = $3.redirections;
+                                    }
 ;
 
-in_out_cmd:  in_redir out_redir cmd { finalPipeLine.commands.push_back($3); }
-          |  in_redir cmd out_redir { finalPipeLine.commands.push_back($2); }
-          |  out_redir in_redir cmd { finalPipeLine.commands.push_back($3); }
-          |  out_redir cmd in_redir { finalPipeLine.commands.push_back($2); }
-          |  cmd in_redir out_redir { finalPipeLine.commands.push_back($1); }
-          |  cmd out_redir in_redir { finalPipeLine.commands.push_back($1); }
-          |  in_redir cmd           { finalPipeLine.commands.push_back($2); }
-          |  cmd in_redir           { finalPipeLine.commands.push_back($1); }
-          |  out_redir cmd          { finalPipeLine.commands.push_back($2); }
-          |  cmd out_redir          { finalPipeLine.commands.push_back($1); }
-          |  cmd                    { finalPipeLine.commands.push_back($1); }
+stage:       redirs cmd redirs      { SYNTAX_ERROR_IF($1.flags & $3.flags);
+                                      $$.cmd = $2;
+                                      $$.cmd.error = $1.error != NULL ? $1.error : $3.error;
+                                      $$.cmd.errorToOutput = $1.errorToOutput || $3.errorToOutput;
+                                      $$.redirections = $1.flags | $3.flags;
+                                    }
 ;
 
-in_redir:    LT WORD                { finalPipeLine.input = std::string($2); free($2);}
+redirs:      /* can be empty */     { $$ = redirection(0); }
+          |  redirs redir           { SYNTAX_ERROR_IF($1.flags & $2.flags);
+                                      $$.flags = $1.flags | $2.flags;
+                                      $$.error = $2.error != NULL ? $2.error : $1.error;
+                                      $$.errorToOutput = $1.errorToOutput || $2.errorToOutput;
+                                    }
 ;
 
-out_redir:   GT WORD                { finalPipeLine.output = std::string($2); free($2);}
+redir:       LT WORD                { finalPipeLine.input = std::string($2); $$ = redirection(kRedirectsInput); }
+          |  HERE WORD              { finalPipeLine.hereString = std::string($2); $$ = redirection(kRedirectsInput); }
+          |  GT WORD                { finalPipeLine.output = std::string($2); $$ = redirection(kRedirectsOutput); }
+          |  APPEND WORD            { finalPipeLine.output = std::string($2);
+                                      finalPipeLine.append = true;
+                                      $$ = redirection(kRedirectsOutput);
+                                    }
+          |  ERR_GT WORD            { $$ = redirection(kRedirectsError, $2); }
+          |  ERR_TO_OUT             { $$ = redirection(kRedirectsError, NULL, true); }
+          |  AMP_GT WORD            { finalPipeLine.output = std::string($2);
+                                      $$ = redirection(kRedirectsOutput | kRedirectsError, NULL, true);
+                                    }
 ;
 
-cmd:    WORD arg_list               { strncpy($$.command, $1, kMaxCommandLength);
-                                      free($1);
-                                      $$.command[kMaxCommandLength] = '\0';
-                                      size_t i;
-                                      for (i = 0; i < std::min((size_t)$2->size(), kMaxArguments); i++) {
-                                        $$.tokens[i] = $2->at(i);
+cmd:    WORD arg_list               { char **argv = finalPipeLine.storage.allocate<char *>($2.count + 2);
+                                      size_t i = 0;
+                                      argv[i++] = $1;
+                                      for (arena_list<char *>::node *n = $2.head; n != NULL; n = n->next) {
+                                        argv[i++] = n->value;
                                       }
-                                      $$.tokens[i] = NULL; // null terminate the arg list
-                                      delete $2;
+                                      argv[i] = NULL; // null terminate the arg list
+                                      $$.command = argv[0];
+                                      $$.tokens = argv + 1;
+                                      $$.count = $2.count;
+                                      $$.error = NULL;
+                                      $$.errorToOutput = false;
                                     }
 ;
 
 
-arg_list:   /* can be empty */      { $$ = new std::vector<char *>(); }
-          | arg_list WORD           { $$ = $1; $$->push_back($2); }
+arg_list:   /* can be empty */      { $$.clear(); }
+          | arg_list WORD           { $$ = $1; $$.append(finalPipeLine.storage, $2); }
 ;
 
 %%
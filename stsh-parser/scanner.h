@@ -8,8 +8,16 @@
 #ifndef _scanner_h_
 #define _scanner_h_
 
+#include "stsh-arena.h"
+
 extern char *yytext;
 int yylex();
 bool initScanner();
 
+/**
+ * The arena into which the scanner copies WORD tokens.  pipeline::pipeline
+ * points it at the pipeline's own arena for the duration of the parse.
+ */
+extern arena *scannerArena;
+
 #endif
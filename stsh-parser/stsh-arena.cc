@@ -0,0 +1,57 @@
+/**
+ * File: stsh-arena.cc
+ * -------------------
+ * Presents the implementation of the arena class.
+ */
+
+#include "stsh-arena.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+using namespace std;
+
+arena::arena(size_t capacity) : blocks(NULL), cursor(NULL), limit(NULL) {
+  if (capacity > 0) grow(capacity);
+}
+
+arena::~arena() {
+  while (blocks != NULL) {
+    block *next = blocks->next;
+    free(blocks);
+    blocks = next;
+  }
+}
+
+void arena::grow(size_t size) {
+  block *b = static_cast<block *>(malloc(sizeof(block) + size));
+  if (b == NULL) throw bad_alloc();
+  b->next = blocks;
+  blocks = b;
+  cursor = reinterpret_cast<char *>(b + 1);
+  limit = cursor + size;
+}
+
+void arena::reserve(size_t size) {
+  if (cursor == NULL || (size_t) (limit - cursor) < size) grow(size);
+}
+
+void *arena::allocate(size_t size, size_t alignment) {
+  uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t) (alignment - 1);
+  if (cursor == NULL || aligned + size > reinterpret_cast<uintptr_t>(limit)) {
+    size_t previous = blocks == NULL ? 0 : limit - reinterpret_cast<char *>(blocks + 1);
+    grow(max(2 * previous, size + alignment));
+    aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t) (alignment - 1);
+  }
+
+  cursor = reinterpret_cast<char *>(aligned + size);
+  return reinterpret_cast<void *>(aligned);
+}
+
+char *arena::strdup(const char *s, size_t len) {
+  char *copy = allocate<char>(len + 1);
+  memcpy(copy, s, len);
+  copy[len] = '\0';
+  return copy;
+}
@@ -0,0 +1,102 @@
+/**
+ * File: stsh-arena.h
+ * ------------------
+ * Defines the arena class, a bump allocator that owns every token,
+ * argument vector, and command record built while parsing a single
+ * command line.  Memory is handed out by advancing a cursor through a
+ * block sized up front from the length of the line, and everything is
+ * released at once when the arena is destroyed, so parsing a line
+ * costs a constant number of heap allocations no matter how many
+ * arguments it has.
+ *
+ * Also defines arena_list, a singly linked list whose nodes live in an
+ * arena.  It has no constructors, so it can serve as a bison semantic
+ * value while a list of words or commands is being accumulated.
+ */
+
+#ifndef _stsh_arena_
+#define _stsh_arena_
+
+#include <cstddef>
+
+class arena {
+public:
+
+/**
+ * Constructor: arena
+ * ------------------
+ * Constructs an arena whose first block can hold capacity bytes.  If
+ * more than that is ever requested, additional blocks are allocated on
+ * demand.
+ */
+  arena(size_t capacity = 0);
+
+/**
+ * Destructor: ~arena
+ * ------------------
+ * Releases every block, and with it everything allocated from the arena.
+ */
+  ~arena();
+
+/**
+ * Method: reserve
+ * ---------------
+ * Ensures the current block has room for at least size more bytes, so
+ * that a caller who knows how much it needs can get it in one block.
+ */
+  void reserve(size_t size);
+
+/**
+ * Method: allocate
+ * ----------------
+ * Returns uninitialized, suitably aligned storage for count objects of type T.
+ */
+  template <typename T>
+  T *allocate(size_t count) { return static_cast<T *>(allocate(count * sizeof(T), alignof(T))); }
+
+/**
+ * Method: strdup
+ * --------------
+ * Copies the len characters addressed by s into the arena, appends a
+ * '\0', and returns the copy.
+ */
+  char *strdup(const char *s, size_t len);
+
+private:
+  struct block {
+    block *next;
+  };
+
+  block *blocks;
+  char *cursor;
+  char *limit;
+
+  void *allocate(size_t size, size_t alignment);
+  void grow(size_t size);
+  arena(const arena& original) = delete;
+  arena& operator=(const arena& rhs) = delete;
+};
+
+template <typename T>
+struct arena_list {
+  struct node {
+    T value;
+    node *next;
+  };
+
+  node *head;
+  node *tail;
+  size_t count;
+
+  void clear() { head = tail = NULL; count = 0; }
+  void append(arena& storage, const T& value) {
+    node *n = storage.allocate<node>(1);
+    n->value = value;
+    n->next = NULL;
+    if (tail == NULL) head = n; else tail->next = n;
+    tail = n;
+    count++;
+  }
+};
+
+#endif // _stsh_arena_
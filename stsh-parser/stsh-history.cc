@@ -0,0 +1,271 @@
+/**
+ * File: stsh-history.cc
+ * ---------------------
+ * Presents the implementation of the history_file class.
+ */
+
+#include "stsh-history.h"
+#include <cstring>
+#include <unordered_set>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+using namespace std;
+
+static const char kMagic[8] = {'s', 't', 's', 'h', 'h', 'i', 's', 't'};
+static const uint32_t kVersion = 1;
+
+/**
+ * Type: header
+ * ------------
+ * Occupies the first 64 bytes of the file.  end is the offset, within the
+ * records region that follows, just past the last record claimed so far,
+ * and is only ever accessed atomically.
+ */
+struct history_file::header {
+  char magic[8];
+  uint32_t version;
+  uint32_t unused;
+  uint64_t capacity;
+  uint64_t end;
+  char padding[32];
+};
+
+/**
+ * Type: record
+ * ------------
+ * Precedes each line's text, which is padded out to a multiple of four
+ * bytes and followed by a copy of size, so records can be walked backward.
+ * hash is zero until the record has been completely written.
+ */
+struct history_file::record {
+  uint32_t size;
+  uint32_t length;
+  uint32_t hash;
+
+  const char *text() const { return reinterpret_cast<const char *>(this + 1); }
+};
+
+static uint32_t hashLine(const string& line) {
+  uint32_t hash = 2166136261u;
+  for (char ch: line) hash = (hash ^ (unsigned char) ch) * 16777619u;
+  return hash | 1; // never zero, which would read as "not yet written"
+}
+
+/**
+ * Function: isRecordSize
+ * ----------------------
+ * Returns true iff size could be that of a record with at most room bytes
+ * available to it.
+ */
+static bool isRecordSize(uint32_t size, uint64_t room) {
+  return size >= 4 * sizeof(uint32_t) && size % 4 == 0 && size <= room;
+}
+
+static uint32_t sizeAt(const char *records, uint64_t offset) {
+  return __atomic_load_n(reinterpret_cast<const uint32_t *>(records + offset), __ATOMIC_ACQUIRE); // record::size comes first
+}
+
+static uint32_t trailerBefore(const char *records, uint64_t offset) {
+  uint32_t size;
+  memcpy(&size, records + offset - sizeof(size), sizeof(size));
+  return size;
+}
+
+history_file::history_file() : fd(-1), mapping(NULL), records(NULL), length(0) {}
+
+history_file::~history_file() {
+  if (mapping != NULL) munmap(mapping, length);
+  if (fd != -1) close(fd);
+}
+
+bool history_file::open(const string& path, size_t capacity) {
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd == -1) return false;
+  flock(fd, LOCK_EX); // another session may be creating the same file
+  struct stat info;
+  bool created = fstat(fd, &info) == 0 && info.st_size == 0;
+  if (created && ftruncate(fd, sizeof(header) + capacity) == 0) info.st_size = sizeof(header) + capacity;
+  if (info.st_size > (off_t) sizeof(header)) {
+    void *base = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base != MAP_FAILED) {
+      mapping = static_cast<header *>(base);
+      records = static_cast<char *>(base) + sizeof(header);
+      length = info.st_size;
+    }
+  }
+
+  if (mapping != NULL && created) {
+    memcpy(mapping->magic, kMagic, sizeof(kMagic));
+    mapping->version = kVersion;
+    mapping->capacity = capacity;
+  }
+
+  bool valid = mapping != NULL && memcmp(mapping->magic, kMagic, sizeof(kMagic)) == 0 &&
+    mapping->version == kVersion && mapping->capacity == length - sizeof(header) &&
+    __atomic_load_n(&mapping->end, __ATOMIC_ACQUIRE) <= mapping->capacity;
+  flock(fd, LOCK_UN);
+  if (valid) return true;
+  if (mapping != NULL) munmap(mapping, length);
+  close(fd);
+  fd = -1;
+  mapping = NULL;
+  return false;
+}
+
+/**
+ * Method: last
+ * ------------
+ * Returns the record ending at offset end, or NULL if there isn't one or
+ * it's still being written.
+ */
+const history_file::record *history_file::last(uint64_t end) const {
+  if (end == 0) return NULL;
+  uint32_t size = trailerBefore(records, end);
+  if (size == 0 || size > end) return NULL; // claimed, but the trailer isn't written yet
+  const record *r = reinterpret_cast<const record *>(records + end - size);
+  if (__atomic_load_n(&r->hash, __ATOMIC_ACQUIRE) == 0) return NULL;
+  return r;
+}
+
+/**
+ * Method: starts
+ * --------------
+ * Returns the offset of every record that ends at or before end, found by
+ * walking forward from the start of the region.  That's only needed when
+ * some record has no trailer to walk backward over.
+ */
+vector<uint64_t> history_file::starts(uint64_t end) const {
+  vector<uint64_t> offsets;
+  for (uint64_t offset = 0; offset < end;) {
+    uint32_t size = sizeAt(records, offset);
+    if (!isRecordSize(size, end - offset)) break; // only a damaged file looks like this
+    offsets.push_back(offset);
+    offset += size;
+  }
+
+  return offsets;
+}
+
+vector<string> history_file::recent(size_t count) const {
+  vector<string> lines;
+  if (mapping == NULL) return lines;
+  flock(fd, LOCK_SH); // keeps compaction from rewriting the records as we read them
+  uint64_t end = __atomic_load_n(&mapping->end, __ATOMIC_ACQUIRE);
+  while (lines.size() < count && end > 0) {
+    uint32_t size = trailerBefore(records, end);
+    if (!isRecordSize(size, end)) { // an append in progress, or one whose session died, so walk forward instead
+      vector<uint64_t> offsets = starts(end);
+      for (auto it = offsets.rbegin(); it != offsets.rend() && lines.size() < count; ++it) {
+        const record *r = reinterpret_cast<const record *>(records + *it);
+        if (__atomic_load_n(&r->hash, __ATOMIC_ACQUIRE) != 0) lines.push_back(string(r->text(), r->length));
+      }
+
+      break;
+    }
+
+    const record *r = reinterpret_cast<const record *>(records + end - size);
+    if (__atomic_load_n(&r->hash, __ATOMIC_ACQUIRE) != 0) lines.push_back(string(r->text(), r->length));
+    end -= size;
+  }
+
+  flock(fd, LOCK_UN);
+  return vector<string>(lines.rbegin(), lines.rend());
+}
+
+void history_file::append(const string& line) {
+  if (mapping == NULL || line.empty() || line.size() > mapping->capacity / 8) return;
+  uint32_t size = sizeof(record) + ((line.size() + 3) & ~size_t(3)) + sizeof(uint32_t);
+  uint32_t hash = hashLine(line);
+  uint64_t end;
+  flock(fd, LOCK_SH); // excludes compaction, but not other appends
+  while (true) {
+    end = __atomic_load_n(&mapping->end, __ATOMIC_ACQUIRE);
+    const record *previous = last(end);
+    if (previous != NULL && previous->hash == hash && previous->length == line.size() &&
+        memcmp(previous->text(), line.data(), line.size()) == 0) {
+      flock(fd, LOCK_UN);
+      return;
+    }
+
+    if (end + size > mapping->capacity) {
+      flock(fd, LOCK_UN);
+      compact(size);
+      flock(fd, LOCK_SH);
+      continue;
+    }
+
+    uint32_t claimed = 0;
+    uint32_t *slot = reinterpret_cast<uint32_t *>(records + end); // record::size comes first
+    if (__atomic_compare_exchange_n(slot, &claimed, size, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      __atomic_compare_exchange_n(&mapping->end, &end, end + size, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); // unless another session already has
+      break;
+    }
+
+    if (!isRecordSize(claimed, mapping->capacity - end)) { // only a damaged file looks like this
+      flock(fd, LOCK_UN);
+      return;
+    }
+
+    __atomic_compare_exchange_n(&mapping->end, &end, end + claimed, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); // help whoever won, then retry
+  }
+
+  record *r = reinterpret_cast<record *>(records + end);
+  memcpy(records + end + size - sizeof(size), &size, sizeof(size));
+  r->length = line.size();
+  memcpy(records + end + sizeof(record), line.data(), line.size());
+  __atomic_store_n(&r->hash, hash, __ATOMIC_RELEASE);
+  flock(fd, LOCK_UN);
+}
+
+/**
+ * Method: compact
+ * ---------------
+ * Rewrites the records region in place so that at least needed bytes are
+ * free: duplicates are dropped in favor of their latest occurrence, and
+ * then the oldest lines are dropped until at most half the capacity is
+ * in use.  Because the rewrite happens within the shared mapping, every
+ * session sees it immediately.
+ */
+void history_file::compact(size_t needed) {
+  flock(fd, LOCK_EX);
+  uint64_t end = __atomic_load_n(&mapping->end, __ATOMIC_ACQUIRE);
+  while (mapping->capacity - end >= sizeof(uint32_t) && isRecordSize(sizeAt(records, end), mapping->capacity - end)) {
+    end += sizeAt(records, end); // claimed by a session that died before advancing the end past it
+  }
+
+  __atomic_store_n(&mapping->end, end, __ATOMIC_RELEASE);
+
+  if (end + needed <= mapping->capacity) { // someone else compacted while we waited
+    flock(fd, LOCK_UN);
+    return;
+  }
+
+  vector<const record *> all;
+  for (uint64_t offset = 0; offset < end;) {
+    const record *r = reinterpret_cast<const record *>(records + offset);
+    if (!isRecordSize(r->size, end - offset)) break; // only a damaged file looks like this
+    if (r->hash != 0) all.push_back(r);
+    offset += r->size;
+  }
+
+  unordered_set<string> seen;
+  vector<const record *> kept;
+  uint64_t budget = mapping->capacity / 2, used = 0;
+  for (auto it = all.rbegin(); it != all.rend() && used + (*it)->size <= budget; ++it) {
+    if (seen.insert(string((*it)->text(), (*it)->length)).second) {
+      kept.push_back(*it);
+      used += (*it)->size;
+    }
+  }
+
+  string compacted;
+  compacted.reserve(used);
+  for (auto it = kept.rbegin(); it != kept.rend(); ++it) compacted.append((const char *) *it, (*it)->size);
+  memcpy(records, compacted.data(), compacted.size());
+  memset(records + compacted.size(), 0, end - compacted.size());
+  __atomic_store_n(&mapping->end, compacted.size(), __ATOMIC_RELEASE);
+  flock(fd, LOCK_UN);
+}
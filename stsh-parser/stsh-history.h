@@ -0,0 +1,95 @@
+/**
+ * File: stsh-history.h
+ * --------------------
+ * Defines the history_file class, which persists command history in a
+ * memory-mapped file shared by every stsh session that opens it.
+ *
+ * The file is a small header followed by a fixed-capacity, append-only
+ * region of records.  Each record carries its size at both ends, so the
+ * region can be walked forward (during compaction) or backward (to load
+ * the most recent lines), and loading the last few hundred lines costs
+ * the same whether the file holds ten lines or a million.
+ *
+ * Sessions append concurrently without waiting on one another: space for
+ * a record is claimed with an atomic compare-and-swap of its size into the
+ * (zeroed) bytes at the shared end offset, the end offset is then advanced
+ * past it by whichever session gets there first, and the record is
+ * published by storing its hash last.  A session that dies partway through
+ * leaves behind a record whose size is known but whose hash is zero, which
+ * every walk skips.  Only compaction, which runs when the region fills up,
+ * needs the file to itself: it drops duplicate lines (keeping the latest
+ * occurrence of each) and then the oldest ones until the region is at most
+ * half full.
+ */
+
+#ifndef _stsh_history_
+#define _stsh_history_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class history_file {
+public:
+  static const size_t kDefaultCapacity = 1 << 22;
+
+/**
+ * Constructor: history_file
+ * -------------------------
+ * Constructs a history_file that isn't backed by anything until open
+ * succeeds.
+ */
+  history_file();
+
+/**
+ * Destructor: ~history_file
+ * -------------------------
+ * Unmaps and closes the file, if one was opened.
+ */
+  ~history_file();
+
+/**
+ * Method: open
+ * ------------
+ * Opens (creating it if need be) the history file at path, and returns
+ * true iff it could be opened and mapped.  A new file is sized to hold
+ * capacity bytes of records; an existing file keeps whatever capacity it
+ * was created with.  Files that don't look like stsh history files are
+ * left alone, and open returns false.
+ */
+  bool open(const std::string& path, size_t capacity = kDefaultCapacity);
+
+/**
+ * Method: recent
+ * --------------
+ * Returns up to count of the most recently appended lines, oldest first.
+ */
+  std::vector<std::string> recent(size_t count) const;
+
+/**
+ * Method: append
+ * --------------
+ * Appends line to the file, unless it's identical to the line appended
+ * last (by any session) or too long to be worth keeping.  Compacts the
+ * file first if there isn't room for it.
+ */
+  void append(const std::string& line);
+
+private:
+  struct header;
+  struct record;
+
+  int fd;
+  header *mapping;
+  char *records;
+  size_t length;
+
+  const record *last(uint64_t end) const;
+  std::vector<uint64_t> starts(uint64_t end) const;
+  void compact(size_t needed);
+  history_file(const history_file& original) = delete;
+  history_file& operator=(const history_file& rhs) = delete;
+};
+
+#endif
@@ -0,0 +1,173 @@
+/**
+ * File: stsh-parse-bench.cc
+ * -------------------------
+ * Benchmarks the bison-generated parser against the hand-written one by
+ * parsing every line of a corpus with each, and confirms along the way that
+ * the two build identical pipelines.  The corpus is read from the file named
+ * on the command line, one command line per line, or synthesized if no
+ * file is given.
+ *
+ *     ./stsh-parse-bench [--rounds n] [corpus-file]
+ */
+
+#include "stsh-parse.h"
+#include "stsh-parse-exception.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+static const int kIncorrectUsage = 1;
+static const int kMismatch = 2;
+static const size_t kSyntheticLines = 20000;
+
+static void printUsage(const string& message, const string& executable) {
+  cerr << "Error: " << message << endl;
+  cerr << "Usage: ./" << executable << " [--rounds n] [corpus-file]" << endl;
+  exit(kIncorrectUsage);
+}
+
+/**
+ * Function: synthesizeCorpus
+ * --------------------------
+ * Generates a mix of short commands, long argument lists, pipelines,
+ * redirections, here-strings, quoted words, prefixes, and background jobs.
+ */
+static void synthesizeCorpus(vector<string>& lines) {
+  for (size_t i = 0; i < kSyntheticLines; i++) {
+    string line;
+    switch (i % 7) {
+    case 0: line = "ls -l /tmp"; break;
+    case 1: line = "cat < input.txt | grep -v \"some pattern\" | sort | uniq -c > output.txt"; break;
+    case 2: line = "./spin " + to_string(i % 10) + " &"; break;
+    case 3:
+      line = "echo";
+      for (size_t j = 0; j < 64; j++) line += " argument" + to_string(j);
+      break;
+    case 4: line = "> out.txt ./conduit --delay 1 --count " + to_string(i % 7) + " < in.txt"; break;
+    case 5: line = "time pipesize=1M nice=10 sort <<< \"b a\" 2> errors.txt | uniq -c >> counts.txt"; break;
+    case 6: line = "placement=auto ionice=idle make -j8 2>&1 | tee build.log &"; break;
+    }
+
+    lines.push_back(line);
+  }
+}
+
+/**
+ * Function: sameCommand
+ * ---------------------
+ * Returns true iff the two commands have the same arguments and redirect
+ * standard error the same way.
+ */
+static bool sameCommand(const command& a, const command& b) {
+  if (a.count != b.count || a.errorToOutput != b.errorToOutput) return false;
+  if ((a.error == NULL) != (b.error == NULL) || (a.error != NULL && strcmp(a.error, b.error) != 0)) return false;
+  char **x = a.argv(), **y = b.argv();
+  for (; *x != NULL && *y != NULL; x++, y++) {
+    if (strcmp(*x, *y) != 0) return false;
+  }
+
+  return *x == NULL && *y == NULL;
+}
+
+/**
+ * Function: samePipeline
+ * ----------------------
+ * Returns true iff the two pipelines agree on every field the parser fills
+ * in, including those recorded from prefixes.
+ */
+static bool samePipeline(const pipeline& a, const pipeline& b) {
+  if (a.input != b.input || a.hereString != b.hereString || a.output != b.output || a.append != b.append) return false;
+  if (a.timed != b.timed || a.pipeSize != b.pipeSize || a.placement != b.placement || a.priority != b.priority) return false;
+  if (a.commands.size() != b.commands.size()) return false;
+  if (!a.commands.empty() && a.background != b.background) return false;
+  for (size_t i = 0; i < a.commands.size(); i++) {
+    if (!sameCommand(a.commands[i], b.commands[i])) return false;
+  }
+
+  return true;
+}
+
+/**
+ * Function: timeParser
+ * --------------------
+ * Parses every line in the corpus rounds times with the specified engine and
+ * returns the elapsed time in seconds.  Lines that fail to parse are counted,
+ * but otherwise ignored.
+ */
+static double timeParser(const vector<string>& lines, size_t rounds, parse_engine engine, size_t& failures) {
+  failures = 0;
+  auto start = chrono::steady_clock::now();
+  for (size_t r = 0; r < rounds; r++) {
+    for (const string& line: lines) {
+      try {
+        pipeline p(line, engine);
+      } catch (const STSHParseException& e) {
+        failures++;
+      }
+    }
+  }
+
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  size_t rounds = 5;
+  string corpus;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--rounds") == 0) {
+      if (++i == argc) printUsage("--rounds requires an argument.", argv[0]);
+      char *end;
+      rounds = strtoul(argv[i], &end, 10);
+      if (*end != '\0' || argv[i][0] == '-' || rounds == 0) printUsage("Number of rounds must be a positive integer.", argv[0]);
+    } else if (corpus.empty()) {
+      corpus = argv[i];
+    } else {
+      printUsage("Too many arguments.", argv[0]);
+    }
+  }
+
+  vector<string> lines;
+  if (corpus.empty()) {
+    synthesizeCorpus(lines);
+  } else {
+    ifstream infile(corpus.c_str());
+    if (!infile) printUsage("Could not open \"" + corpus + "\".", argv[0]);
+    string line;
+    while (getline(infile, line)) lines.push_back(line);
+  }
+
+  cerr.setstate(ios::failbit); // silence the "ERROR: syntax error" diagnostics while checking and timing
+  size_t mismatches = 0;
+  for (const string& line: lines) {
+    bool bisonOK = true, handOK = true;
+    try { pipeline a(line, kBisonParser); } catch (const STSHParseException& e) { bisonOK = false; }
+    try { pipeline b(line, kHandwrittenParser); } catch (const STSHParseException& e) { handOK = false; }
+    if (bisonOK != handOK) {
+      mismatches++;
+    } else if (bisonOK && !samePipeline(pipeline(line, kBisonParser), pipeline(line, kHandwrittenParser))) {
+      mismatches++;
+    }
+  }
+
+  size_t bisonFailures, handFailures;
+  double bison = timeParser(lines, rounds, kBisonParser, bisonFailures);
+  double hand = timeParser(lines, rounds, kHandwrittenParser, handFailures);
+  cerr.clear();
+
+  size_t parsed = lines.size() * rounds;
+  cout << lines.size() << " lines x " << rounds << " rounds (" << bisonFailures / rounds << " with syntax errors)" << endl;
+  cout << "  flex/bison:  " << bison * 1e9 / parsed << " ns/line" << endl;
+  cout << "  handwritten: " << hand * 1e9 / parsed << " ns/line" << endl;
+  cout << "  speedup:     " << bison / hand << "x" << endl;
+  if (mismatches > 0) {
+    cout << mismatches << " lines were parsed differently by the two parsers." << endl;
+    return kMismatch;
+  }
+
+  return 0;
+}
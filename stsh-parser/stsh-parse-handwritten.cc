@@ -0,0 +1,259 @@
+/**
+ * File: stsh-parse-handwritten.cc
+ * -------------------------------
+ * Presents a hand-written, single-pass alternative to the flex scanner and
+ * bison parser.  It walks the line in place (no copy of the line is ever made,
+ * and tokens are views into it until they're committed to the arena), and it
+ * accepts exactly the language described by parser.y and scanner.l, building
+ * the same pipeline structure out of the same arena.
+ */
+
+#include "stsh-parse.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+/**
+ * Type: token
+ * -----------
+ * A token is a view into the line being parsed: text addresses its first
+ * character, and length is the number of characters in it.
+ */
+enum token_type {
+  kWord, kLessThan, kGreaterThan, kPipe, kAmpersand, kEnd,
+  kHere, kAppend, kErrorGreaterThan, kErrorToOutput, kAmpersandGreaterThan
+};
+struct token {
+  token_type type;
+  const char *text;
+  size_t length;
+};
+
+static bool isBlank(char ch) {
+  return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+/**
+ * Type: operator_spelling
+ * -----------------------
+ * The operators of scanner.l, each of which matches the WORD rule just as
+ * well and so wins the tie, but only when the whole run of non-blank
+ * characters is exactly the operator.
+ */
+struct operator_spelling {
+  const char *text;
+  token_type type;
+};
+
+static const operator_spelling kOperators[] = {
+  {"<<<", kHere}, {">>", kAppend}, {"2>&1", kErrorToOutput}, {"2>", kErrorGreaterThan},
+  {"&>", kAmpersandGreaterThan}, {"<", kLessThan}, {">", kGreaterThan}, {"|", kPipe}, {"&", kAmpersand}
+};
+
+/**
+ * Class: scanner
+ * --------------
+ * Tokenizes the characters in [cursor, end) according to the rules in
+ * scanner.l.  Like flex, it always prefers the longest possible match, and
+ * breaks ties in favor of the rule listed first, so, for instance, "<" on its
+ * own is a redirection, but "<in" is a word.
+ */
+class scanner {
+public:
+  scanner(const char *begin, const char *end) : cursor(begin), end(end) {}
+
+  token next() {
+    while (cursor < end && isBlank(*cursor)) cursor++;
+    token t = { kEnd, cursor, 0 };
+    if (cursor == end) return t;
+
+    const char *run = cursor;
+    while (run < end && !isBlank(*run)) run++;
+    size_t wordLength = run - cursor;
+    size_t quotedLength = *cursor == '"' ? matchQuoted() : 0;
+
+    t.type = kWord;
+    t.length = max(wordLength, quotedLength);
+    if (t.length <= 4) {
+      for (const operator_spelling& op: kOperators) {
+        if (strlen(op.text) == t.length && strncmp(op.text, cursor, t.length) == 0) {
+          t.type = op.type;
+          break;
+        }
+      }
+    }
+
+    cursor += t.length;
+    return t;
+  }
+
+private:
+  const char *cursor;
+  const char *end;
+
+/**
+ * Returns the length of the longest match of \"(\\.|[^\"])*\" starting at
+ * cursor, or 0 if there is none.  Inside the quotes, a backslash may either
+ * escape the next character (as long as it isn't a newline) or stand for
+ * itself, so both possibilities are tracked at once.
+ */
+  size_t matchQuoted() const {
+    size_t longest = 0;
+    bool inside = true, escaped = false;
+    for (const char *p = cursor + 1; p < end && (inside || escaped); p++) {
+      bool nextInside = false, nextEscaped = false;
+      if (escaped && *p != '\n') nextInside = true;
+      if (inside) {
+        if (*p == '"') {
+          longest = p - cursor + 1;
+        } else {
+          nextInside = true;
+          if (*p == '\\') nextEscaped = true;
+        }
+      }
+
+      inside = nextInside;
+      escaped = nextEscaped;
+    }
+
+    return longest;
+  }
+};
+
+/**
+ * Function: parseCommand
+ * ----------------------
+ * Consumes a WORD and every WORD immediately following it, and lays them
+ * down in the arena as a single argument vector, exactly as the cmd rule
+ * in parser.y does.  On return, t is the first token after the command.
+ */
+static command parseCommand(pipeline& p, scanner& s, token& t) {
+  arena_list<char *> words;
+  words.clear();
+  while (t.type == kWord) {
+    words.append(p.storage, p.storage.strdup(t.text, t.length));
+    t = s.next();
+  }
+
+  char **argv = p.storage.allocate<char *>(words.count + 1);
+  size_t i = 0;
+  for (arena_list<char *>::node *n = words.head; n != NULL; n = n->next) {
+    argv[i++] = n->value;
+  }
+
+  argv[i] = NULL;
+  command cmd;
+  cmd.command = argv[0];
+  cmd.tokens = argv + 1;
+  cmd.count = words.count - 1;
+  cmd.error = NULL;
+  cmd.errorToOutput = false;
+  return cmd;
+}
+
+/**
+ * Function: parseRedirection
+ * --------------------------
+ * Consumes the redirection starting with t (and the file name or word that
+ * follows it, if any), records it in the pipeline (or, for standard error,
+ * in the stage's own error and errorToOutput), and returns the flags
+ * describing which streams it redirects, or 0 if it's malformed.  On
+ * return, t is the first token after the redirection.
+ */
+enum { kRedirectsInput = 1, kRedirectsOutput = 2, kRedirectsError = 4 };
+static unsigned parseRedirection(pipeline& p, scanner& s, token& t, char *& error, bool& errorToOutput) {
+  token_type type = t.type;
+  t = s.next();
+  if (type == kErrorToOutput) {
+    errorToOutput = true;
+    return kRedirectsError;
+  }
+
+  if (t.type != kWord) return 0;
+  token word = t;
+  t = s.next();
+  switch (type) {
+  case kLessThan: p.input.assign(word.text, word.length); return kRedirectsInput;
+  case kHere: p.hereString.assign(word.text, word.length); return kRedirectsInput;
+  case kGreaterThan: p.output.assign(word.text, word.length); return kRedirectsOutput;
+  case kAppend: p.output.assign(word.text, word.length); p.append = true; return kRedirectsOutput;
+  case kErrorGreaterThan: error = p.storage.strdup(word.text, word.length); return kRedirectsError;
+  case kAmpersandGreaterThan:
+    p.output.assign(word.text, word.length);
+    errorToOutput = true;
+    return kRedirectsOutput | kRedirectsError;
+  default: return 0;
+  }
+}
+
+static bool isRedirection(token_type type) {
+  return type == kLessThan || type == kGreaterThan || type == kHere || type == kAppend ||
+    type == kErrorGreaterThan || type == kErrorToOutput || type == kAmpersandGreaterThan;
+}
+
+/**
+ * Function: parseByHand
+ * ---------------------
+ * Each stage of the pipeline is a command surrounded by any number of
+ * redirections.  Input redirection is only legal in the first stage, and
+ * output redirection is only legal in the last one, but any stage may
+ * redirect its standard error.  A stage may redirect each of its streams at
+ * most once, and may contain only one command.  The pipeline may be followed by any number of ampersands.
+ */
+static bool parseByHand(pipeline& p, const string& str) {
+  scanner s(str.data(), str.data() + str.size());
+  token t = s.next();
+  if (t.type == kEnd) return true; // empty input, don't modify the pipeline
+
+  arena_list<command> stages;
+  stages.clear();
+  while (true) {
+    bool sawCommand = false, errorToOutput = false;
+    unsigned redirections = 0;
+    char *error = NULL;
+    command cmd;
+    while (t.type == kWord || isRedirection(t.type)) {
+      if (t.type == kWord) {
+        if (sawCommand) return false;
+        cmd = parseCommand(p, s, t);
+        sawCommand = true;
+        continue;
+      }
+
+      unsigned redirected = parseRedirection(p, s, t, error, errorToOutput);
+      if (redirected == 0 || (redirections & redirected) != 0) return false;
+      if ((redirected & kRedirectsInput) && stages.count > 0) return false;
+      redirections |= redirected;
+    }
+
+    if (!sawCommand) return false;
+    cmd.error = error;
+    cmd.errorToOutput = errorToOutput;
+    stages.append(p.storage, cmd);
+    if (t.type != kPipe) break;
+    if (redirections & kRedirectsOutput) return false; // output redirection only allowed in the last stage
+    t = s.next();
+  }
+
+  while (t.type == kAmpersand) {
+    p.background = true;
+    t = s.next();
+  }
+
+  if (t.type != kEnd) return false;
+  p.commands.count = stages.count;
+  p.commands.elems = p.storage.allocate<command>(stages.count);
+  size_t i = 0;
+  for (arena_list<command>::node *n = stages.head; n != NULL; n = n->next) {
+    p.commands.elems[i++] = n->value;
+  }
+
+  return true;
+}
+
+int parseHandwritten(pipeline& p, const string& str) {
+  if (parseByHand(p, str)) return 0;
+  cerr << "ERROR: syntax error" << endl; // same diagnostic yyerror prints
+  return 1;
+}
@@ -5,46 +5,127 @@
  * in tsh-parse.h.  It mostly delegates the process to yyparse, which
  * is generated in lexer.c and parser.h/.c by yacc from the context free grammar
  * specified in commands.y and by flex from the tokenization rules in commands.l
+ * (or, if so configured, to the hand-written parser in stsh-parse-handwritten.cc).
  */
 
 #include "stsh-parse.h"
 #include "stsh-parse-exception.h"
+#include "stsh-size.h" // for parse_size
 #include "scanner.h"
 #include "parser.h" // for yyparse
 #include <string>
 #include <cstdlib>
+#include <cstring>
 using namespace std;
 
 typedef struct yy_buffer_state *YY_BUFFER_STATE;
 extern int yyparse(pipeline &finalPipeline);
 extern YY_BUFFER_STATE yy_scan_string(const char * str);
 extern void yy_delete_buffer(YY_BUFFER_STATE buffer);
+extern int parseHandwritten(pipeline& p, const string& str); // see stsh-parse-handwritten.cc
 
-pipeline::pipeline(const string& str) {
+/**
+ * Function: arenaCapacity
+ * -----------------------
+ * Returns an upper bound on the number of arena bytes needed to parse the
+ * provided line, so that the arena can be sized with a single allocation.
+ * Every word is at least one character followed by a separator, so there
+ * are at most half as many words as characters (plus one), and there is
+ * at most one more command than there are '|' characters.
+ */
+static size_t arenaCapacity(const string& str) {
+  size_t words = str.size() / 2 + 1;
+  size_t commands = 1;
+  for (char ch: str) if (ch == '|') commands++;
+  size_t text = str.size() + words * (1 + alignof(void *)); // each word, its '\0', and alignment padding
+  size_t wordNodes = words * sizeof(arena_list<char *>::node);
+  size_t commandNodes = commands * sizeof(arena_list<command>::node);
+  size_t records = commands * sizeof(command);
+  size_t vectors = (words + commands) * sizeof(char *);  // each argv and its NULL terminator
+  return text + wordNodes + commandNodes + records + vectors + 4 * alignof(command);
+}
+
+static int parseWithBison(pipeline& p, const string& str) {
+  scannerArena = &p.storage;
   YY_BUFFER_STATE state = yy_scan_string(str.c_str());
-  int result = yyparse(*this);
+  int result = yyparse(p);
   yy_delete_buffer(state);
-  if (result != 0) throw STSHParseException();
+  scannerArena = NULL;
+  return result;
+}
+
+/**
+ * Function: stripPrefix
+ * ---------------------
+ * Drops the leading word of the provided command by advancing its argument
+ * vector by one (no tokens are copied), leaving the word after it in its place.
+ */
+static void stripPrefix(command& first) {
+  first.command = first.tokens[0];
+  first.tokens++;
+  first.count--;
 }
 
-pipeline::~pipeline() {
-  input.clear();
-  output.clear();
-  for (const command& cmd: commands) {
-    for (size_t i = 0; i <= kMaxArguments && cmd.tokens[i] != NULL; i++) {
-      free(cmd.tokens[i]);
+/**
+ * Function: stripPrefixes
+ * -----------------------
+ * Recognizes the prefixes documented in stsh-parse.h at the front of an
+ * already parsed pipeline, records them, and drops them from the leading
+ * command.  Both parsers treat prefixes as ordinary words, so they're
+ * recognized here, once, for both of them.  A prefix with nothing after it
+ * is left alone, so that, say, "time" on its own is still a command.
+ */
+static void stripPrefixes(pipeline& p) {
+  static const string kPipeSizePrefix = "pipesize=";
+  static const string kPlacementPrefix = "placement=";
+  if (p.commands.empty()) return;
+  command& first = p.commands[0];
+  while (first.count > 0) {
+    if (strcmp(first.command, "time") == 0) {
+      p.timed = true;
+    } else if (strncmp(first.command, kPipeSizePrefix.c_str(), kPipeSizePrefix.size()) == 0) {
+      if (!parse_size(first.command + kPipeSizePrefix.size(), p.pipeSize) || p.pipeSize == 0) {
+        throw STSHParseException("Invalid pipe size \"" + string(first.command + kPipeSizePrefix.size()) + "\".");
+      }
+    } else if (strncmp(first.command, kPlacementPrefix.c_str(), kPlacementPrefix.size()) == 0) {
+      p.placement = first.command + kPlacementPrefix.size();
+    } else if (strncmp(first.command, "nice=", 5) == 0 || strncmp(first.command, "ionice=", 7) == 0 ||
+               strncmp(first.command, "sched=", 6) == 0) {
+      p.priority.push_back(first.command);
+    } else {
+      break;
     }
+
+    stripPrefix(first);
   }
 }
 
+pipeline::pipeline(const string& str, parse_engine engine)
+  : storage(arenaCapacity(str)), append(false), background(false), timed(false), pipeSize(0) {
+  commands.elems = NULL;
+  commands.count = 0;
+  int result = engine == kHandwrittenParser ? parseHandwritten(*this, str) : parseWithBison(*this, str);
+  if (result != 0) throw STSHParseException();
+  stripPrefixes(*this);
+}
+
+pipeline::~pipeline() {}
+
 ostream& operator<<(ostream& os, const pipeline& p) {
   if (!p.input.empty()) os << "Input File: " << p.input << endl;
-  if (!p.output.empty()) os << "Output File: " << p.output << endl;
+  if (!p.hereString.empty()) os << "Here String: " << p.hereString << endl;
+  if (!p.output.empty()) os << (p.append ? "Append File: " : "Output File: ") << p.output << endl;
+  if (p.timed) os << "Timed" << endl;
+  if (p.pipeSize != 0) os << "Pipe Size: " << p.pipeSize << endl;
+  if (!p.placement.empty()) os << "Placement: " << p.placement << endl;
+  for (const string& setting: p.priority) os << "Priority: " << setting << endl;
   for (size_t i = 0; i < p.commands.size(); i++) {
     os << "Executable " << i << ": " << p.commands[i].command << endl;
-    for (size_t j = 0; j <= kMaxArguments && p.commands[i].tokens[j] != NULL; j++) {
+    for (size_t j = 0; p.commands[i].tokens[j] != NULL; j++) {
       os << "       Arg " << j << ": " << p.commands[i].tokens[j] << endl;
     }
+    if (p.commands[i].error != NULL) os << "       Error File: " << p.commands[i].error << endl;
+    if (p.commands[i].errorToOutput) os << "       Error To Output" << endl;
   }
   return os;
 }
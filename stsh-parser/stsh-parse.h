@@ -13,20 +13,71 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include "stsh-arena.h"
 
-const size_t kMaxCommandLength = 32;
-const size_t kMaxArguments = 32;
-
+/**
+ * A single command and its arguments, laid out in the pipeline's arena as
+ * one contiguous, NULL-terminated argument vector.  command is the vector's
+ * first entry and tokens addresses the entry just after it, so argv() can
+ * be handed to execvp directly, without copying.  There is no limit on the
+ * length of the command or on the number of arguments.
+ */
 struct command {
-  char command[kMaxCommandLength + 1]; // '\0'-terminated
-  char *tokens[kMaxArguments + 1]; // array, C strings are all '\0'-terminated
+  char *command;  // '\0'-terminated, same as argv()[0]
+  char **tokens;  // NULL-terminated array of count arguments, C strings are all '\0'-terminated
+  size_t count;
+  char *error;    // file to redirect standard error to (2>), or NULL if none
+  bool errorToOutput; // true iff standard error goes wherever standard output goes (2>&1, &>)
+
+  char **argv() const { return tokens - 1; }
 };
 
+/**
+ * A fixed-length sequence of commands that lives in a pipeline's arena.
+ * It supports just enough of the std::vector interface (size, empty,
+ * indexing, and range-based for loops) to stand in for one.
+ */
+struct command_list {
+  command *elems;
+  size_t count;
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  command& operator[](size_t i) { return elems[i]; }
+  const command& operator[](size_t i) const { return elems[i]; }
+  command *begin() { return elems; }
+  command *end() { return elems + count; }
+  const command *begin() const { return elems; }
+  const command *end() const { return elems + count; }
+};
+
+/**
+ * Identifies the two interchangeable parsers.  kBisonParser is the flex
+ * scanner and bison grammar in scanner.l and parser.y, and kHandwrittenParser
+ * is the single-pass, zero-copy parser in stsh-parse-handwritten.cc, which
+ * accepts the same language and builds the same pipelines.  The default is
+ * chosen at build time: compile with -DSTSH_HANDWRITTEN_PARSER to select the
+ * hand-written one.
+ */
+enum parse_engine { kBisonParser, kHandwrittenParser };
+#ifdef STSH_HANDWRITTEN_PARSER
+const parse_engine kDefaultParser = kHandwrittenParser;
+#else
+const parse_engine kDefaultParser = kBisonParser;
+#endif
+
 struct pipeline {
+  arena storage;       // owns the tokens and command records below; must come first
   std::string input;   // empty if no input redirection file to first command
+  std::string hereString; // empty if no here-string (<<< word) to feed the first command
   std::string output;  // empty if no output redirection file from last command
-  std::vector<command> commands;
+  bool append;         // true iff output should be appended to (>>) rather than truncated
+  command_list commands;
   bool background;
+  bool timed;          // true iff the line was prefixed with the time keyword
+  size_t pipeSize;     // capacity requested for the pipes between commands, or 0 for the default
+  std::string placement; // where the commands should run (see stsh-placement.h), or empty for the default
+  std::vector<std::string> priority; // scheduling settings to run the commands with (see stsh-priority.h)
 
 /**
  * Accepts a command line and parses it to construct the pipeline.
@@ -50,9 +101,9 @@ struct pipeline {
  * is parsed, unsurprisingly, as 2 tokens.
  *
  * For each command, the first token is taken to be the name of the command,
- * and the following tokens are the arguments.  The first token is placed in the
- * command field of a struct command, and the remaining tokens are laid down
- * in the tokens array field.
+ * and the following tokens are the arguments.  All of them are laid down, in
+ * order, in a single argument vector: the command field of a struct command
+ * addresses the first token, and the tokens field addresses the remaining ones.
  *
  * The first command in the list (or the only command if no pipes are found)
  * also allows for input redirection of the form "< input" where input is the
@@ -64,15 +115,55 @@ struct pipeline {
  * output is the name of a file to be created that will hold the results of the
  * final command.
  *
+ * Output redirection can also take the forms ">> output", which appends to
+ * output rather than truncating it, and "&> output", which sends standard
+ * error to output as well.  Input redirection can instead take the form
+ * "<<< word", which feeds the first command the word (less any surrounding
+ * double quotes) and a newline.
+ *
+ * Every command, not just the last, may also redirect its standard error,
+ * either with "2> error", which sends it to the file named error, or with
+ * "2>&1", which sends it wherever that command's standard output goes (the
+ * next pipe, the output file, or the terminal).  These are recorded in the
+ * error and errorToOutput fields of the command itself, as in
+ *
+ *   make 2>&1 | grep warning
+ *
  * Note that in the case of a single command, the one command can have both
  * input and output redirection, and those options can be specified in any
  * order. That is: "< input" , "> output", and  "command [args...]" can be
- * written in any order.
+ * written in any order.  Each command may redirect its input at most once,
+ * its standard output at most once, and its standard error at most once
+ * ("&> output" counts as both).
+ *
+ * A line may start with any number of prefixes, each of which is parsed as
+ * though it weren't there (provided some command follows them):
+ *
+ *   time             sets timed to true
+ *   pipesize=<size>  sets pipeSize, where size is a number of bytes, optionally
+ *                    followed by K, M, or G
+ *   placement=<spec> sets placement to spec, which is interpreted by the shell
+ *   nice=<n>, ionice=<class>[:<level>], sched=<policy>
+ *                    are appended to priority, and interpreted by the shell
+ *
+ * so that
+ *
+ *   time pipesize=1M sort data | uniq -c
+ *
+ * is a two-command pipeline whose execution should be timed, and whose
+ * commands should be connected by a pipe that can hold a megabyte.
+ * Prefixes are parsed as words of the leading command, so a redirection
+ * can't come between them and the command itself: "< data time sort" is
+ * fine, but "time < data sort" is a syntax error.
+ *
+ * The engine argument selects which parser does the work, and is really
+ * only of interest to benchmarks comparing the two.
  */
-  pipeline(const std::string& str);
+  pipeline(const std::string& str, parse_engine engine = kDefaultParser);
 
 /**
- * It frees the dynamically allocated char *s containing the argument lists.
+ * Everything the parser allocated lives in storage, and is released
+ * in one shot when the pipeline is destroyed.
  */
   ~pipeline();
 };
@@ -3,23 +3,129 @@
  * ----------------------
  * Presents the implementation of the readline function, which can be configured to use 
  * the GNU readline library.
+ *
+ * GNU readline is loaded lazily, with dlopen, the first time a line is read
+ * from a terminal with history enabled.  stsh runs that never prompt a person
+ * (scripts, -c, input from a pipe or file) never load it at all, and so don't
+ * pay for mapping and relocating it at startup.  If it can't be loaded, lines
+ * are read exactly as they are with --no-history.
+ *
+ * Lines read through GNU readline are also saved to a history file shared
+ * by every stsh session (see stsh-history.h): $STSH_HISTORY if it's set,
+ * and ~/.stsh_history otherwise.  Setting STSH_HISTORY to the empty
+ * string keeps history from outliving the session.
  */
 
 #include "stsh-readline.h"
+#include "stsh-history.h"
 #include <readline/readline.h>
 #include <readline/history.h>
 
 #include <iostream>
+#include <cstdlib>
 #include <algorithm> 
 #include <functional> 
 #include <cctype>
 #include <locale>
 #include <getopt.h>
+#include <unistd.h>
+#include <dlfcn.h>
 #include "string-utils.h"
 using namespace std;
 
 static string prompt = "stsh> ";
 static bool history = true;
+
+/**
+ * Type: readline_library
+ * ----------------------
+ * The handful of GNU readline and history functions stsh calls, as
+ * resolved from the dynamically loaded library.
+ */
+struct readline_library {
+  char *(*readline)(const char *prompt);
+  int (*add_history)(const char *line);
+  void (*callback_handler_install)(const char *prompt, rl_vcpfunc_t *handler);
+  void (*callback_handler_remove)();
+  void (*callback_read_char)();
+};
+
+static readline_library rl;
+
+/**
+ * Function: loadReadline
+ * ----------------------
+ * Loads GNU readline and resolves the functions in rl, returning true iff
+ * all of them were found.  Only the first call does any work.
+ */
+static bool loadReadline() {
+  static const char *const kLibraryNames[] = {"libreadline.so.8", "libreadline.so", "libreadline.so.7"};
+  static int loaded = -1; // -1 until the first call, and then 0 or 1
+  if (loaded != -1) return loaded;
+  loaded = 0;
+  void *library = NULL;
+  for (const char *name: kLibraryNames) {
+    if ((library = dlopen(name, RTLD_NOW | RTLD_LOCAL)) != NULL) break;
+  }
+
+  if (library == NULL) return false;
+  rl.readline = (char *(*)(const char *)) dlsym(library, "readline");
+  rl.add_history = (int (*)(const char *)) dlsym(library, "add_history");
+  rl.callback_handler_install = (void (*)(const char *, rl_vcpfunc_t *)) dlsym(library, "rl_callback_handler_install");
+  rl.callback_handler_remove = (void (*)()) dlsym(library, "rl_callback_handler_remove");
+  rl.callback_read_char = (void (*)()) dlsym(library, "rl_callback_read_char");
+  loaded = rl.readline != NULL && rl.add_history != NULL && rl.callback_handler_install != NULL &&
+    rl.callback_handler_remove != NULL && rl.callback_read_char != NULL;
+  return loaded;
+}
+
+static history_file persisted;
+static const size_t kRestoredLines = 1000;
+
+/**
+ * Function: restoreHistory
+ * ------------------------
+ * Opens the shared history file and hands the most recent lines in it
+ * to GNU readline.
+ */
+static void restoreHistory() {
+  const char *path = getenv("STSH_HISTORY");
+  const char *home = getenv("HOME");
+  string file = path != NULL ? path : home != NULL ? string(home) + "/.stsh_history" : "";
+  if (file.empty() || !persisted.open(file)) return;
+  for (const string& line: persisted.recent(kRestoredLines))
+    rl.add_history(line.c_str());
+}
+
+/**
+ * Function: usingReadline
+ * -----------------------
+ * Returns true iff lines should be read through GNU readline: history is
+ * enabled, standard input is a terminal, and the library could be loaded.
+ * The persisted history is restored the first time that's so.
+ */
+static bool usingReadline() {
+  static bool restored = false;
+  if (!history || !isatty(STDIN_FILENO) || !loadReadline()) return false;
+  if (!restored) {
+    restored = true;
+    restoreHistory();
+  }
+
+  return true;
+}
+
+/**
+ * Function: remember
+ * ------------------
+ * Adds the provided line to GNU readline's history and to the shared
+ * history file.
+ */
+static void remember(const string& line) {
+  rl.add_history(line.c_str());
+  persisted.append(line);
+}
+
 static const int kIncorrectUsage = 1;
 static void printUsage(const string& message, const string& executable) {
   cerr << "Error: " << message << endl;
@@ -55,19 +161,93 @@ void rlinit(int argc, char *argv[]) {
 
 bool readline(string& line) {
   line.clear();
-  if (!history) {
+  if (!usingReadline()) {
     cout << prompt;
     getline(cin, line);
     trim(line);
     return !cin.eof();
   }
   
-  char *s = readline(prompt.c_str());
+  char *s = rl.readline(prompt.c_str());
   if (s == NULL) return false;
   line = s;
   free(s);
   trim(line);
   if (!line.empty()) 
-    add_history(line.c_str());
+    remember(line);
+  return true;
+}
+
+/**
+ * Asynchronous line assembly.  When reading through GNU readline, its
+ * callback interface does the work, and the line it hands back is parked
+ * in pending until rlcontinue picks it up.  Otherwise, raw input is
+ * accumulated in buffer and split on newlines here.
+ */
+static string buffer;
+static string pending;
+static bool complete = false;
+static bool reachedEOF = false;
+
+static bool callbacks = false; // true iff the line being assembled comes through readline's callbacks
+
+static void lineHandler(char *s) {
+  rl.callback_handler_remove(); // don't prompt again until rlbegin is called
+  complete = true;
+  if (s == NULL) {
+    reachedEOF = true;
+    return;
+  }
+
+  pending = s;
+  free(s);
+}
+
+void rlbegin() {
+  complete = false;
+  reachedEOF = false;
+  pending.clear();
+  callbacks = usingReadline();
+  if (callbacks) {
+    rl.callback_handler_install(prompt.c_str(), lineHandler);
+  } else {
+    cout << prompt << flush;
+  }
+}
+
+bool rlbuffered() {
+  return !callbacks && buffer.find('\n') != string::npos;
+}
+
+bool rlcontinue(string& line, bool& eof) {
+  eof = false;
+  line.clear();
+  if (callbacks) {
+    rl.callback_read_char();
+    if (!complete) return false;
+    eof = reachedEOF;
+    line = pending;
+  } else {
+    if (!rlbuffered()) {
+      char chunk[4096];
+      ssize_t count = read(STDIN_FILENO, chunk, sizeof(chunk));
+      if (count > 0) buffer.append(chunk, count);
+      if (count == 0 && buffer.empty()) {
+        eof = true;
+        return true;
+      }
+
+      if (count != 0 && !rlbuffered()) return false;
+    }
+
+    size_t newline = buffer.find('\n');
+    if (newline == string::npos) newline = buffer.size(); // last line lacks a newline
+    line = buffer.substr(0, newline);
+    buffer.erase(0, newline + 1);
+  }
+
+  trim(line);
+  if (callbacks && !line.empty())
+    remember(line);
   return true;
 }
@@ -29,4 +29,34 @@ void rlinit(int argc, char *argv[]);
  */
 bool readline(std::string& line);
 
+/**
+ * Function: rlbegin
+ * -----------------
+ * Starts reading a new line without blocking, for callers that multiplex
+ * terminal input with other events.  The prompt is printed right away,
+ * and the line itself is assembled by subsequent calls to rlcontinue.
+ */
+void rlbegin();
+
+/**
+ * Function: rlcontinue
+ * --------------------
+ * Consumes whatever input is currently available on standard input, and
+ * should only be called once standard input is known to be readable (or
+ * rlbuffered returns true).  rlcontinue returns true once the line started
+ * by rlbegin is complete, in which case it has been placed in line, or
+ * once EOF was detected without any text being entered, in which case eof
+ * is set to true.  Otherwise it returns false and should be called again
+ * when more input arrives.
+ */
+bool rlcontinue(std::string& line, bool& eof);
+
+/**
+ * Function: rlbuffered
+ * --------------------
+ * Returns true iff a complete line has already been read from standard
+ * input and buffered, so rlcontinue can be called without waiting.
+ */
+bool rlbuffered();
+
 #endif
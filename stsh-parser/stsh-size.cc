@@ -0,0 +1,30 @@
+/**
+ * File: stsh-size.cc
+ * ------------------
+ * Presents the implementation of parse_size, as documented in stsh-size.h.
+ */
+
+#include "stsh-size.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+using namespace std;
+
+bool parse_size(const char *text, size_t& size) {
+  char *end;
+  if (!isdigit(*text)) return false;
+  errno = 0;
+  size = strtoul(text, &end, 10);
+  if (errno == ERANGE) return false;
+  int shift = 0;
+  switch (toupper(*end)) {
+  case 'G': shift += 10; // fall through
+  case 'M': shift += 10; // fall through
+  case 'K': shift += 10; end++; break;
+  }
+
+  if (size > SIZE_MAX >> shift) return false;
+  size <<= shift;
+  return *end == '\0';
+}
@@ -0,0 +1,21 @@
+/**
+ * File: stsh-size.h
+ * -----------------
+ * Defines parse_size, which reads the sizes accepted by pipesize= prefixes,
+ * the limit builtin, and the --pipe-size option, and also by flood, which
+ * links against stsh-size.o alone rather than the whole parser.
+ */
+
+#ifndef _stsh_size_
+#define _stsh_size_
+
+#include <cstddef>
+
+/**
+ * Parses text as a size in bytes, optionally followed by K, M, or G (for
+ * KiB, MiB, or GiB), storing it in size.  Returns false if text isn't a
+ * well-formed size, or names one too large for a size_t.
+ */
+bool parse_size(const char *text, size_t& size);
+
+#endif // _stsh_size_
@@ -0,0 +1,68 @@
+/**
+ * File: stsh-path-cache.cc
+ * ------------------------
+ * Presents the implementation of the STSHPathCache class.
+ */
+
+#include "stsh-path-cache.h"
+#include <cstdlib>
+#include <iomanip>
+#include <unistd.h>
+#include <sys/stat.h>
+using namespace std;
+
+static const char *const kDefaultPath = "/bin:/usr/bin"; // what execvp searches if $PATH isn't set
+
+static bool isExecutable(const string& path) {
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode) && access(path.c_str(), X_OK) == 0;
+}
+
+void STSHPathCache::synchronize() {
+  const char *path = getenv("PATH");
+  if (path == NULL) path = kDefaultPath;
+  if (searchPath != path) {
+    entries.clear();
+    searchPath = path;
+  }
+}
+
+string STSHPathCache::resolve(const string& name) {
+  if (name.empty() || name.find('/') != string::npos) return name;
+  synchronize();
+  auto found = entries.find(name);
+  if (found != entries.end()) {
+    found->second.hits++;
+    return found->second.path;
+  }
+
+  size_t start = 0;
+  while (true) {
+    size_t end = searchPath.find(':', start);
+    string dir = searchPath.substr(start, end == string::npos ? string::npos : end - start);
+    string candidate = (dir.empty() ? "." : dir) + "/" + name;
+    if (isExecutable(candidate)) {
+      if (!dir.empty() && dir[0] == '/') {
+        entry e = { candidate, 1 };
+        entries[name] = e;
+      }
+      return candidate;
+    }
+
+    if (end == string::npos) return "";
+    start = end + 1;
+  }
+}
+
+bool STSHPathCache::forget(const string& name) {
+  return entries.erase(name) > 0;
+}
+
+ostream& operator<<(ostream& os, const STSHPathCache& cache) {
+  os << "hits\tcommand" << endl;
+  for (const auto& e: cache.entries) {
+    os << setw(4) << e.second.hits << "\t" << e.second.path << endl;
+  }
+
+  return os;
+}
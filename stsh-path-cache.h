@@ -0,0 +1,75 @@
+/**
+ * File: stsh-path-cache.h
+ * -----------------------
+ * Defines the STSHPathCache class, which remembers where each command was
+ * found along $PATH (much like bash's hash table), so that launching a
+ * command the shell has run before costs a single execve on an absolute
+ * path instead of a failed execve for every $PATH directory that precedes
+ * the right one.  execvp performs that search in the freshly forked child,
+ * so its cost is paid again on every launch.
+ *
+ * Entries are keyed by command name.  The whole table is discarded whenever
+ * $PATH changes, and a single entry can be discarded (via forget) when the
+ * file it names turns out to be gone.
+ */
+
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <iostream>
+
+class STSHPathCache {
+
+/**
+ * Overloaded version of operator<< that lists every cached command along
+ * with the number of times the cached path has been used, in the same
+ * format as bash's hash builtin.
+ */
+  friend std::ostream& operator<<(std::ostream& os, const STSHPathCache& cache);
+
+public:
+
+/**
+ * Method: resolve
+ * ---------------
+ * Returns the path of the executable that execvp would run for the named
+ * command, or the empty string if there isn't one.  Names that contain a
+ * slash are returned as is, since execvp doesn't search $PATH for them.
+ * Paths found through relative $PATH entries (including empty ones, which
+ * stand for the current directory) are returned but never cached.
+ */
+  std::string resolve(const std::string& name);
+
+/**
+ * Method: forget
+ * --------------
+ * Discards the cached path for the named command, if there is one, and
+ * returns true iff there was.
+ */
+  bool forget(const std::string& name);
+
+/**
+ * Method: clear
+ * -------------
+ * Discards every cached path.
+ */
+  void clear() { entries.clear(); }
+
+/**
+ * Method: empty
+ * -------------
+ * Returns true iff nothing is cached.
+ */
+  bool empty() const { return entries.empty(); }
+
+private:
+  struct entry {
+    std::string path;
+    size_t hits;
+  };
+
+  std::unordered_map<std::string, entry> entries;
+  std::string searchPath; // value of $PATH when the entries were gathered
+
+  void synchronize();
+};
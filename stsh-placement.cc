@@ -0,0 +1,194 @@
+/**
+ * File: stsh-placement.cc
+ * -----------------------
+ * Presents the implementation of the placement functions described in
+ * stsh-placement.h.
+ */
+
+#include "stsh-placement.h"
+#include "stsh-exception.h"
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+using namespace std;
+
+static const int kMaxNodes = 1024;
+static const string kNodeDirectory = "/sys/devices/system/node/";
+static const string kCPUDirectory = "/sys/devices/system/cpu/";
+
+/**
+ * Function: parseCPUList
+ * ----------------------
+ * Parses a list of CPU (or node) numbers and ranges, as in 0-3,8, which is
+ * also the format sysfs uses, into cpus.  Returns false if it's malformed.
+ */
+static bool parseCPUList(const string& list, cpu_set_t& cpus) {
+  CPU_ZERO(&cpus);
+  const char *s = list.c_str();
+  while (true) {
+    if (!isdigit(*s)) return false;
+    char *end;
+    long first = strtol(s, &end, 10), last = first;
+    if (*end == '-') {
+      if (!isdigit(end[1])) return false;
+      last = strtol(end + 1, &end, 10);
+    }
+
+    if (last < first || last >= CPU_SETSIZE) return false;
+    for (long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, &cpus);
+    if (*end == '\0') return true;
+    if (*end != ',') return false;
+    s = end + 1;
+  }
+}
+
+static bool readCPUList(const string& path, cpu_set_t& cpus) {
+  ifstream file(path.c_str());
+  string list;
+  return (file >> list) && parseCPUList(list, cpus);
+}
+
+static bool readNodeCPUs(int node, cpu_set_t& cpus) {
+  return readCPUList(kNodeDirectory + "node" + to_string(node) + "/cpulist", cpus);
+}
+
+static cpu_set_t allowedCPUs() {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+    CPU_ZERO(&allowed);
+    for (long cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN) && cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, &allowed);
+  }
+
+  return allowed;
+}
+
+STSHPlacement parsePlacement(const string& spec) {
+  static const string kCPUsPrefix = "cpus:";
+  static const string kNodePrefix = "node:";
+  STSHPlacement placement;
+  if (spec == "none") return placement;
+  if (spec == "auto") {
+    placement.kind = STSHPlacement::kAuto;
+    return placement;
+  }
+
+  if (spec.compare(0, kCPUsPrefix.size(), kCPUsPrefix) == 0 &&
+      parseCPUList(spec.substr(kCPUsPrefix.size()), placement.cpus)) {
+    placement.kind = STSHPlacement::kCPUs;
+    return placement;
+  }
+
+  if (spec.compare(0, kNodePrefix.size(), kNodePrefix) == 0 && spec.size() > kNodePrefix.size()) {
+    char *end;
+    long node = strtol(spec.c_str() + kNodePrefix.size(), &end, 10);
+    if (isdigit(spec[kNodePrefix.size()]) && *end == '\0' && node < kMaxNodes) {
+      placement.kind = STSHPlacement::kNode;
+      placement.node = node;
+      return placement;
+    }
+  }
+
+  throw STSHException("Malformed placement \"" + spec + "\" (expected none, auto, node:<n>, or cpus:<list>).");
+}
+
+/**
+ * Function: siblingOrder
+ * ----------------------
+ * Returns the CPUs in available, ordered so that the SMT siblings of each
+ * core are adjacent, and cores appear in the order of their lowest CPU.
+ */
+static vector<int> siblingOrder(const cpu_set_t& available) {
+  vector<int> order;
+  cpu_set_t placed;
+  CPU_ZERO(&placed);
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (!CPU_ISSET(cpu, &available) || CPU_ISSET(cpu, &placed)) continue;
+    cpu_set_t siblings;
+    if (!readCPUList(kCPUDirectory + "cpu" + to_string(cpu) + "/topology/thread_siblings_list", siblings)) {
+      CPU_ZERO(&siblings);
+      CPU_SET(cpu, &siblings);
+    }
+
+    for (int sibling = 0; sibling < CPU_SETSIZE; sibling++) {
+      if (CPU_ISSET(sibling, &siblings) && CPU_ISSET(sibling, &available) && !CPU_ISSET(sibling, &placed)) {
+        order.push_back(sibling);
+        CPU_SET(sibling, &placed);
+      }
+    }
+  }
+
+  return order;
+}
+
+/**
+ * Function: planAuto
+ * ------------------
+ * Packs count stages onto the CPUs of the node the shell is running on,
+ * starting wherever the previous auto placement left off.
+ */
+static vector<STSHStagePlacement> planAuto(size_t count) {
+  static size_t cursor = 0;
+  cpu_set_t available = allowedCPUs();
+  int cpu = sched_getcpu(), node = -1;
+  cpu_set_t online; // node numbers, in the same format as CPU numbers
+  if (cpu < 0 || !readCPUList(kNodeDirectory + "online", online)) CPU_ZERO(&online);
+  for (int n = 0; n < kMaxNodes; n++) {
+    cpu_set_t cpus;
+    if (!CPU_ISSET(n, &online) || !readNodeCPUs(n, cpus)) continue;
+    if (CPU_ISSET(cpu, &cpus)) {
+      node = n;
+      CPU_AND(&available, &available, &cpus);
+      break;
+    }
+  }
+
+  vector<int> order = siblingOrder(available);
+  if (order.empty()) throw STSHException("No CPUs are available for placement.");
+  vector<STSHStagePlacement> stages(count);
+  for (size_t i = 0; i < count; i++) {
+    CPU_ZERO(&stages[i].cpus);
+    CPU_SET(order[(cursor + i) % order.size()], &stages[i].cpus);
+    stages[i].node = node;
+  }
+
+  cursor = (cursor + count) % order.size();
+  return stages;
+}
+
+vector<STSHStagePlacement> planPlacement(const STSHPlacement& placement, size_t count) {
+  if (placement.kind == STSHPlacement::kNone) return vector<STSHStagePlacement>();
+  if (placement.kind == STSHPlacement::kAuto) return planAuto(count);
+
+  STSHStagePlacement stage;
+  stage.node = -1;
+  cpu_set_t allowed = allowedCPUs();
+  if (placement.kind == STSHPlacement::kCPUs) {
+    CPU_AND(&stage.cpus, &placement.cpus, &allowed);
+  } else {
+    if (!readNodeCPUs(placement.node, stage.cpus)) {
+      throw STSHException("node:" + to_string(placement.node) + ": No such node.");
+    }
+
+    CPU_AND(&stage.cpus, &stage.cpus, &allowed);
+    stage.node = placement.node;
+  }
+
+  if (CPU_COUNT(&stage.cpus) == 0) throw STSHException("None of the requested CPUs are available.");
+  return vector<STSHStagePlacement>(count, stage);
+}
+
+void applyPlacement(const STSHStagePlacement& placement) {
+  sched_setaffinity(0, sizeof(placement.cpus), &placement.cpus);
+  if (placement.node < 0) return;
+  const size_t kBitsPerWord = 8 * sizeof(unsigned long);
+  unsigned long nodes[kMaxNodes / kBitsPerWord] = {0};
+  nodes[placement.node / kBitsPerWord] |= 1UL << (placement.node % kBitsPerWord);
+  syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodes, (unsigned long) kMaxNodes);
+}
+
+bool movePlacement(pid_t pid, const STSHStagePlacement& placement) {
+  return sched_setaffinity(pid, sizeof(placement.cpus), &placement.cpus) == 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * File: stsh-placement.h
+ * ----------------------
+ * Defines how stsh places the stages of a job on particular CPUs and NUMA
+ * nodes.  A placement is described by one of the following:
+ *
+ *   none         stages run wherever the shell itself is allowed to
+ *   cpus:<list>  every stage runs on the listed CPUs, as in cpus:0-3,8
+ *   node:<n>     every stage runs on node n's CPUs, and allocates its
+ *                memory from node n whenever it can
+ *   auto         stages are packed onto the CPUs of the node the shell is
+ *                running on, one CPU per stage, so that adjacent stages land
+ *                on SMT siblings of the same core (and then on neighboring
+ *                cores), and allocate memory from that node
+ *
+ * A placement can be given to every job (with --placement=), to a single
+ * job (with a placement= prefix), or to a job that's already running (with
+ * the pin builtin).
+ *
+ * The CPU set is applied with sched_setaffinity and the memory node with
+ * set_mempolicy(MPOL_PREFERRED), both in the child before it execs, so
+ * placed stages are always forked, even when the spawn engine is selected.
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <sched.h>
+#include <sys/types.h>
+
+/**
+ * Type: STSHPlacement
+ * -------------------
+ * A parsed placement specification.
+ */
+struct STSHPlacement {
+  enum Kind { kNone, kCPUs, kNode, kAuto } kind;
+  cpu_set_t cpus; // the CPUs named by cpus:<list>
+  int node;       // the node named by node:<n>
+
+  STSHPlacement() : kind(kNone), node(-1) { CPU_ZERO(&cpus); }
+};
+
+/**
+ * Type: STSHStagePlacement
+ * ------------------------
+ * Where a single stage should run: the CPUs it may run on, and the node it
+ * should prefer to allocate memory from (or -1 for no preference).
+ */
+struct STSHStagePlacement {
+  cpu_set_t cpus;
+  int node;
+};
+
+/**
+ * Function: parsePlacement
+ * ------------------------
+ * Parses a placement specification of one of the forms listed above,
+ * throwing an STSHException if it's malformed.
+ */
+STSHPlacement parsePlacement(const std::string& spec);
+
+/**
+ * Function: planPlacement
+ * -----------------------
+ * Returns a placement for each of the count stages of a job, in order.  CPUs
+ * the shell isn't itself allowed to run on are never included, and an
+ * STSHException is thrown if that leaves nothing.  Successive auto
+ * placements pick up where the last one left off, so that concurrent jobs
+ * don't all pile onto the same cores.  Returns an empty vector for kNone.
+ */
+std::vector<STSHStagePlacement> planPlacement(const STSHPlacement& placement, size_t count);
+
+/**
+ * Function: applyPlacement
+ * ------------------------
+ * Applies the provided placement to the calling process.  Only ever called
+ * in a freshly forked child; failures are ignored, since the stage can
+ * still run correctly wherever it ends up.
+ */
+void applyPlacement(const STSHStagePlacement& placement);
+
+/**
+ * Function: movePlacement
+ * -----------------------
+ * Moves the (already running) process with the provided pid onto the CPUs
+ * of the provided placement, returning false if it can't.  A process's
+ * memory policy can only be set by the process itself, so the node
+ * preference is left alone.
+ */
+bool movePlacement(pid_t pid, const STSHStagePlacement& placement);
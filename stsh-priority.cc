@@ -0,0 +1,162 @@
+/**
+ * File: stsh-priority.cc
+ * ----------------------
+ * Presents the implementation of the scheduling functions described in
+ * stsh-priority.h.
+ */
+
+#include "stsh-priority.h"
+#include "stsh-exception.h"
+#include <cerrno>
+#include <cstdlib>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+using namespace std;
+
+// from linux/ioprio.h, which older systems don't have
+static const int kIOPriorityClassShift = 13;
+static const int kIOPriorityClassRT = 1;
+static const int kIOPriorityClassBE = 2;
+static const int kIOPriorityClassIdle = 3;
+static const int kIOPriorityWhoProcess = 1;
+static const int kIOPriorityWhoGroup = 2;
+
+static int ioPriority(int ioClass, int level) {
+  return (ioClass << kIOPriorityClassShift) | level;
+}
+
+/**
+ * Function: parseInteger
+ * ----------------------
+ * Parses text as an integer between low and high, inclusive, returning
+ * false if it isn't one.
+ */
+static bool parseInteger(const string& text, int low, int high, int& value) {
+  char *end;
+  long parsed = strtol(text.c_str(), &end, 10);
+  if (text.empty() || *end != '\0' || parsed < low || parsed > high) return false;
+  value = parsed;
+  return true;
+}
+
+static bool parseIOPriority(const string& spec, int& value) {
+  if (spec == "idle") {
+    value = ioPriority(kIOPriorityClassIdle, 0);
+    return true;
+  }
+
+  string name = spec.substr(0, spec.find(':'));
+  int ioClass = name == "rt" ? kIOPriorityClassRT : name == "be" ? kIOPriorityClassBE : 0;
+  int level = 4; // the kernel's default for both classes
+  if (ioClass == 0) return false;
+  if (name.size() < spec.size() && !parseInteger(spec.substr(name.size() + 1), 0, 7, level)) return false;
+  value = ioPriority(ioClass, level);
+  return true;
+}
+
+static bool parsePolicy(const string& name, int& policy) {
+  if (name == "other") policy = SCHED_OTHER;
+  else if (name == "batch") policy = SCHED_BATCH;
+  else if (name == "idle") policy = SCHED_IDLE;
+  else return false;
+  return true;
+}
+
+STSHPriority parsePriority(const vector<string>& settings) {
+  STSHPriority priority;
+  for (const string& setting: settings) {
+    size_t equals = setting.find('=');
+    string name = setting.substr(0, equals);
+    string value = equals == string::npos ? "" : setting.substr(equals + 1);
+    bool valid;
+    if (name == "nice") {
+      valid = priority.hasNice = parseInteger(value, -20, 19, priority.nice);
+    } else if (name == "ionice") {
+      valid = priority.hasIOPriority = parseIOPriority(value, priority.ioPriority);
+    } else if (name == "sched") {
+      valid = priority.hasPolicy = parsePolicy(value, priority.policy);
+    } else {
+      valid = false;
+    }
+
+    if (!valid) {
+      throw STSHException("Malformed setting \"" + setting + "\" (expected nice=<n>, ionice=<class>[:<level>], or sched=<policy>).");
+    }
+  }
+
+  return priority;
+}
+
+STSHPriority parsePriorityList(const string& list) {
+  vector<string> settings;
+  for (size_t start = 0; start <= list.size(); ) {
+    size_t comma = list.find(',', start);
+    if (comma == string::npos) comma = list.size();
+    settings.push_back(list.substr(start, comma - start));
+    start = comma + 1;
+  }
+
+  return parsePriority(settings);
+}
+
+STSHPriority getInteractivePriority() {
+  static STSHPriority interactive;
+  if (!interactive.empty()) return interactive;
+  errno = 0;
+  int nice = getpriority(PRIO_PROCESS, 0);
+  interactive.hasNice = true;
+  interactive.nice = errno == 0 ? nice : 0;
+  long io = syscall(SYS_ioprio_get, kIOPriorityWhoProcess, 0);
+  interactive.hasIOPriority = true;
+  interactive.ioPriority = io > 0 ? io : 0; // 0 means none was set, which ioprio_set accepts as well
+  int policy = sched_getscheduler(0);
+  interactive.hasPolicy = true;
+  interactive.policy = policy < 0 ? SCHED_OTHER : policy & ~SCHED_RESET_ON_FORK;
+  return interactive;
+}
+
+/**
+ * Function: setPolicy
+ * -------------------
+ * Switches the process with the provided pid (0 for the caller) to the
+ * provided non-real-time policy, whose only priority is 0.
+ */
+static bool setPolicy(pid_t pid, int policy) {
+  sched_param param;
+  param.sched_priority = 0;
+  return sched_setscheduler(pid, policy, &param) == 0;
+}
+
+void applyPriority(const STSHPriority& priority) {
+  if (priority.hasPolicy) setPolicy(0, priority.policy);
+  if (priority.hasNice) setpriority(PRIO_PROCESS, 0, priority.nice);
+  if (priority.hasIOPriority) syscall(SYS_ioprio_set, kIOPriorityWhoProcess, 0, priority.ioPriority);
+}
+
+bool applyGroupPriority(pid_t pgid, const vector<pid_t>& pids, const STSHPriority& priority) {
+  bool applied = true;
+  int error = 0;
+  if (priority.hasPolicy) {
+    for (pid_t pid: pids) {
+      if (!setPolicy(pid, priority.policy) && errno != ESRCH) { // ESRCH: that stage has already exited
+        applied = false;
+        error = errno;
+      }
+    }
+  }
+
+  if (priority.hasNice && setpriority(PRIO_PGRP, pgid, priority.nice) < 0) {
+    applied = false;
+    error = errno;
+  }
+
+  if (priority.hasIOPriority && syscall(SYS_ioprio_set, kIOPriorityWhoGroup, pgid, priority.ioPriority) < 0) {
+    applied = false;
+    error = errno;
+  }
+
+  errno = error;
+  return applied;
+}
@@ -0,0 +1,96 @@
+/**
+ * File: stsh-priority.h
+ * ---------------------
+ * Defines the CPU and I/O scheduling settings stsh can launch a job with,
+ * or impose on a job it moves to the background.  Each setting takes one
+ * of the following forms:
+ *
+ *   nice=<n>                 the nice value, from -20 (favored) to 19
+ *   ionice=<class>[:<level>] the I/O class (rt, be, or idle) and, for rt
+ *                            and be, the level from 0 (favored) to 7
+ *   sched=<policy>           the CPU scheduling policy: other (the
+ *                            default), batch (for throughput-oriented
+ *                            work), or idle (only runs when nothing else
+ *                            wants the CPU)
+ *
+ * Any of them can prefix a command line, as in
+ *
+ *     nice=10 ionice=idle sched=batch make -j8 &
+ *
+ * in which case every stage applies them to itself before it execs (and so
+ * is always forked, even when the spawn engine is selected).
+ *
+ * Without privileges, a process can't undo every setting: a nice value can
+ * only be raised, and only SCHED_BATCH can be left for SCHED_OTHER.  That's
+ * why the demotion used by --demote-bg defaults to sched=batch,ionice=idle,
+ * which fg can always restore.
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * Type: STSHPriority
+ * ------------------
+ * A set of scheduling settings, any of which may be absent.
+ */
+struct STSHPriority {
+  bool hasNice;
+  int nice;
+  bool hasIOPriority;
+  int ioPriority; // class and level, encoded as ioprio_set expects
+  bool hasPolicy;
+  int policy;     // SCHED_OTHER, SCHED_BATCH, or SCHED_IDLE
+
+  STSHPriority() : hasNice(false), nice(0), hasIOPriority(false), ioPriority(0), hasPolicy(false), policy(0) {}
+  bool empty() const { return !hasNice && !hasIOPriority && !hasPolicy; }
+};
+
+/**
+ * Function: parsePriority
+ * -----------------------
+ * Parses the provided settings, throwing an STSHException if any of them
+ * is malformed.  Later settings override earlier ones.
+ */
+STSHPriority parsePriority(const std::vector<std::string>& settings);
+
+/**
+ * Function: parsePriorityList
+ * ---------------------------
+ * Parses a comma-separated list of settings, as with nice=10,ionice=idle.
+ */
+STSHPriority parsePriorityList(const std::string& list);
+
+/**
+ * Function: getInteractivePriority
+ * --------------------------------
+ * Returns the settings the shell itself was started with (all three of them),
+ * as captured the first time this is called, which is what a job brought to
+ * the foreground is restored to.
+ */
+STSHPriority getInteractivePriority();
+
+/**
+ * Function: applyPriority
+ * -----------------------
+ * Applies the provided settings to the calling process, which is a stage
+ * that has been forked but hasn't yet exec'ed.  Without privileges, asking
+ * for a nice value lower than the shell's, the rt I/O class, or a way out of
+ * SCHED_IDLE fails with EPERM; such settings are skipped, and the stage runs
+ * with whatever it inherited from the shell instead.
+ */
+void applyPriority(const STSHPriority& priority);
+
+/**
+ * Function: applyGroupPriority
+ * ----------------------------
+ * Applies the provided settings to the running job whose process group is
+ * pgid and whose stages are pids.  The nice value and I/O priority are set
+ * for the whole group, so processes the stages have created are included;
+ * the scheduling policy can only be set process by process, so it's applied
+ * to the stages themselves.  Returns false (with errno set) if any of it
+ * couldn't be applied, but still applies as much as it can.
+ */
+bool applyGroupPriority(pid_t pgid, const std::vector<pid_t>& pids, const STSHPriority& priority);
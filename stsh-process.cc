@@ -5,13 +5,93 @@
  */
 
 #include "stsh-process.h"
-#include <iomanip>  // for setw, left
+#include <iomanip>  // for setw, left, setprecision
+#include <cstdlib>  // for strtol
+#include <fstream>  // for ifstream
+#include <sstream>  // for istringstream
+#include <unistd.h> // for sysconf
 using namespace std;
 
-STSHProcess::STSHProcess(pid_t pid, const command& command, STSHProcessState state) : pid(pid), state(state) {
+STSHProcess::STSHProcess(pid_t pid, const command& command, STSHProcessState state) : pid(pid), state(state), status(0), reaped(false) {
   tokens.push_back(command.command);
   for (char * const *tokenp = &command.tokens[0]; *tokenp != NULL; tokenp++)
     tokens.push_back(*tokenp);
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  ended = started;
+}
+
+double secondsBetween(const timespec& start, const timespec& end) {
+  return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static double toSeconds(const timeval& tv) {
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void STSHProcess::recordExit(const struct rusage& usage, int status, const timespec& when) {
+  ended = when;
+  this->usage = usage;
+  this->status = status;
+  reaped = true;
+}
+
+/**
+ * Function: sampleUsage
+ * ---------------------
+ * Fills in the CPU times (fields 14 and 15 of /proc/<pid>/stat, in clock
+ * ticks) and peak resident set size (VmHWM in /proc/<pid>/status) of a
+ * process that hasn't been reaped yet.  Anything that can't be read is
+ * left at zero.
+ */
+static void sampleUsage(pid_t pid, STSHUsage& result) {
+  string proc = "/proc/" + to_string(pid);
+  ifstream stat(proc + "/stat");
+  string line;
+  if (getline(stat, line) && line.rfind(')') != string::npos) {
+    istringstream fields(line.substr(line.rfind(')') + 2)); // starts at field 3
+    string skipped;
+    for (int field = 3; field < 14; field++) fields >> skipped;
+    unsigned long utime = 0, stime = 0;
+    fields >> utime >> stime;
+    double ticks = sysconf(_SC_CLK_TCK);
+    result.user = utime / ticks;
+    result.system = stime / ticks;
+  }
+
+  ifstream status(proc + "/status");
+  while (getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      result.maxrss = strtol(line.c_str() + 6, NULL, 10);
+      break;
+    }
+  }
+}
+
+STSHUsage STSHProcess::getUsage() const {
+  STSHUsage result;
+  if (reaped) {
+    result.real = secondsBetween(started, ended);
+    result.user = toSeconds(usage.ru_utime);
+    result.system = toSeconds(usage.ru_stime);
+    result.maxrss = usage.ru_maxrss;
+  } else {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    result.real = secondsBetween(started, now);
+    if (pid != 0) sampleUsage(pid, result);
+  }
+
+  return result;
+}
+
+ostream& operator<<(ostream& os, const STSHUsage& usage) {
+  ios::fmtflags flags = os.flags();
+  streamsize precision = os.precision();
+  os << fixed << setprecision(3) << usage.real << "s real " << usage.user << "s user "
+     << usage.system << "s sys " << usage.maxrss << "K maxrss";
+  os.flags(flags);
+  os.precision(precision);
+  return os;
 }
 
 static ostream& operator<<(ostream& os, STSHProcessState state) {
@@ -29,5 +109,5 @@ static ostream& operator<<(ostream& os, STSHProcessState state) {
 ostream& operator<<(ostream& os, const STSHProcess& process) {
   os << setw(5) << process.pid << " " << setw(12) << left << process.state << right;
   for (const string& token: process.tokens) os << " " << token;
-  return os;
+  return os << "  (" << process.getUsage() << ")";
 }
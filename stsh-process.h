@@ -17,6 +17,8 @@
 #include <vector>   // for vector
 #include <string>   // for string
 #include <iostream> // for ostream
+#include <time.h>     // for timespec
+#include <sys/resource.h> // for rusage
 
 /**
  * Enumerated Type: STSHProcessState
@@ -30,6 +32,38 @@ enum STSHProcessState {
   kWaiting, kRunning, kStopped, kTerminated 
 }; // kWaiting was used for debugging purposes, unlikely you'll use it
 
+/**
+ * Type: STSHUsage
+ * ---------------
+ * Summarizes the resources consumed by a process (or, when aggregated by
+ * STSHJob::getUsage, by a whole job).  Times are in seconds, and maxrss is
+ * the peak resident set size in KiB.
+ */
+struct STSHUsage {
+  double real;   // wall-clock time since launch (or between launch and exit)
+  double user;   // CPU time spent in user mode
+  double system; // CPU time spent in the kernel
+  long maxrss;   // peak resident set size, or 0 if unknown
+
+  STSHUsage() : real(0), user(0), system(0), maxrss(0) {}
+};
+
+/**
+ * Function: operator<<
+ * Usage: cout << usage;
+ * ---------------------
+ * Inserts a one-line summary of the provided STSHUsage, as with
+ * "1.204s real 0.800s user 0.100s sys 10240K maxrss".
+ */
+std::ostream& operator<<(std::ostream& os, const STSHUsage& usage);
+
+/**
+ * Function: secondsBetween
+ * ------------------------
+ * Returns the number of seconds that elapsed between two timestamps.
+ */
+double secondsBetween(const timespec& start, const timespec& end);
+
 class STSHProcess {
 
 /**
@@ -48,13 +82,13 @@ public:
  * ------------------------
  * Default constructor, where the process id is set to 0 as a placeholder.
  */
-  STSHProcess(): pid(0) {}
+  STSHProcess(): pid(0), reaped(false) {}
 
 /**
  * Constructor: STSHProcess
  * ------------------------
  * Constructs the object to package the provided pid, command line, and process state
- * together.
+ * together.  The process is taken to have started at the time of construction.
  */
   STSHProcess(pid_t pid, const command& command, STSHProcessState state = kRunning);
 
@@ -80,8 +114,63 @@ public:
  */
   void setState(STSHProcessState state) { this->state = state; }
 
+/**
+ * Method: getTokens
+ * -----------------
+ * Returns the command name followed by its arguments.
+ */
+  const std::vector<std::string>& getTokens() const { return tokens; }
+
+/**
+ * Method: recordExit
+ * ------------------
+ * Records that the process was reaped at when (a CLOCK_MONOTONIC time),
+ * along with the resource usage reported by wait4 (or waitid) when it was,
+ * and its exit status as a shell reports it (128 plus the signal number if
+ * a signal killed it).
+ */
+  void recordExit(const struct rusage& usage, int status, const timespec& when);
+
+/**
+ * Method: getExitStatus
+ * ---------------------
+ * Returns the exit status passed to recordExit, or 0 if it hasn't been
+ * called.
+ */
+  int getExitStatus() const { return status; }
+
+/**
+ * Method: getUsage
+ * ----------------
+ * Returns the resources the process has consumed.  Once the process has been
+ * reaped, that's exactly what recordExit was given; until then, the CPU
+ * times and peak resident set size are sampled from /proc.
+ */
+  STSHUsage getUsage() const;
+
+/**
+ * Method: getStartTime, getEndTime
+ * --------------------------------
+ * Return the CLOCK_MONOTONIC times at which the process was launched and
+ * reaped.  The end time is only meaningful once the process has been reaped.
+ */
+  const timespec& getStartTime() const { return started; }
+  const timespec& getEndTime() const { return ended; }
+
+/**
+ * Method: hasExited
+ * -----------------
+ * Returns true iff recordExit has been called.
+ */
+  bool hasExited() const { return reaped; }
+
 private:
   pid_t pid;
   std::vector<std::string> tokens;
   STSHProcessState state;
+  timespec started;
+  timespec ended;
+  struct rusage usage;
+  int status;
+  bool reaped;
 };
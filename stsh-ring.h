@@ -0,0 +1,69 @@
+/**
+ * File: stsh-ring.h
+ * -----------------
+ * Defines STSHRing, a fixed-capacity, lock-free ring buffer that carries
+ * records from exactly one producer to exactly one consumer.  It exists so
+ * a signal handler (the producer) can hand work to the main loop (the
+ * consumer) without touching anything the main loop might be in the middle
+ * of changing: pushing a record is a copy plus two atomic operations, with
+ * no allocation and no locks, so it's async-signal-safe, and it's correct
+ * no matter where in a call to pop the handler interrupts the main loop.
+ */
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+template <typename T, size_t Capacity>
+class STSHRing {
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+  STSHRing() : head(0), tail(0) {}
+
+/**
+ * Method: push
+ * ------------
+ * Appends a copy of record, returning false (and leaving the ring
+ * unchanged) if the ring is full.  Only ever called by the producer.
+ */
+  bool push(const T& record) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == Capacity) return false;
+    records[h & (Capacity - 1)] = record;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+/**
+ * Method: full
+ * ------------
+ * Returns true iff a push would fail right now.  Only meaningful to the
+ * producer, since the consumer can make room at any time.
+ */
+  bool full() const {
+    return head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire) == Capacity;
+  }
+
+/**
+ * Method: pop
+ * -----------
+ * Removes the oldest record and copies it into record, returning false if
+ * the ring is empty.  Only ever called by the consumer.
+ */
+  bool pop(T& record) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return false;
+    record = records[t & (Capacity - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  T records[Capacity];
+  std::atomic<size_t> head; // advanced only by the producer
+  std::atomic<size_t> tail; // advanced only by the consumer
+
+  STSHRing(const STSHRing& original) = delete;
+  STSHRing& operator=(const STSHRing& rhs) = delete;
+};
@@ -12,10 +12,15 @@
 #include "stsh-exception.h"
 using namespace std;
 
-void installSignalHandler(int signum, handler_t handler) {
+void installSignalHandler(int signum, handler_t handler, bool blockAll) {
   struct sigaction action;  
   action.sa_handler = handler;  
-  sigfillset(&action.sa_mask); // block all signals until the handler has finished executing
+  if (blockAll) {
+    sigfillset(&action.sa_mask); // block all signals until the handler has finished executing
+  } else {
+    sigemptyset(&action.sa_mask); // only signum itself is blocked, as always
+  }
+
   action.sa_flags = SA_RESTART; // restart system calls if possible  
   if (sigaction(signum, &action, NULL) < 0) 
     throw STSHException("Failed to install a handler for signal with number " + to_string(signum) + ".");
@@ -25,7 +25,9 @@ typedef void (*handler_t)(int);
  * Function: installSignalHandler
  * ------------------------------
  * Installs the specified function to catch and handle any 
- * and all signals of the specified category.
+ * and all signals of the specified category.  Unless blockAll is
+ * false, every other signal is blocked while the handler runs; handlers
+ * that touch nothing but async-signal-safe state don't need that.
  */
-void installSignalHandler(int signum, handler_t handler);
+void installSignalHandler(int signum, handler_t handler, bool blockAll = true);
 
@@ -0,0 +1,236 @@
+/**
+ * File: stsh-splice.cc
+ * --------------------
+ * Presents the implementation of the builtin data-movement stages
+ * described in stsh-splice.h.
+ */
+
+#include "stsh-splice.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+using namespace std;
+
+static bool builtinStages = true;
+static const size_t kChunkSize = 1 << 20; // the kernel moves at most a pipe's worth per call anyway
+
+void setBuiltinStages(bool enabled) {
+  builtinStages = enabled;
+}
+
+bool isBuiltinStage(const command& cmd) {
+  if (!builtinStages) return false;
+  bool cat = strcmp(cmd.command, "cat") == 0;
+  if (!cat && strcmp(cmd.command, "tee") != 0) return false;
+  for (size_t i = 0; i < cmd.count; i++) {
+    const char *arg = cmd.tokens[i];
+    if (arg[0] == '-' && !(cat && arg[1] == '\0')) return false; // leave options to the real thing
+  }
+
+  return true;
+}
+
+static bool isPipe(int fd) {
+  struct stat info;
+  return fstat(fd, &info) == 0 && S_ISFIFO(info.st_mode);
+}
+
+/**
+ * Function: hasKnownSize
+ * ----------------------
+ * Returns true iff fd is a regular file with a nonzero size.  Files in
+ * /proc report a size of zero, and copy_file_range copies nothing from them.
+ */
+static bool hasKnownSize(int fd) {
+  struct stat info;
+  return fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0;
+}
+
+/**
+ * Function: isUnsupported
+ * -----------------------
+ * Returns true iff errno says splice, tee, or copy_file_range can't be used
+ * with the descriptors it was given, as opposed to reporting a real I/O error.
+ */
+static bool isUnsupported() {
+  return errno == EINVAL || errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EBADF;
+}
+
+/**
+ * Function: writeAll
+ * ------------------
+ * Writes all count bytes addressed by data to fd, returning false on error.
+ */
+static bool writeAll(int fd, const char *data, size_t count) {
+  while (count > 0) {
+    ssize_t written = write(fd, data, count);
+    if (written < 0 && errno == EINTR) continue;
+    if (written < 0) return false;
+    data += written;
+    count -= written;
+  }
+
+  return true;
+}
+
+/**
+ * Function: copyThroughBuffer
+ * ---------------------------
+ * The fallback for descriptors the kernel can't move data between directly:
+ * reads from in until EOF and writes everything to each descriptor in outs.
+ */
+static bool copyThroughBuffer(int in, const vector<int>& outs) {
+  char buffer[1 << 16];
+  while (true) {
+    ssize_t count = read(in, buffer, sizeof(buffer));
+    if (count == 0) return true;
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0) return false;
+    for (int out: outs) {
+      if (!writeAll(out, buffer, count)) return false;
+    }
+  }
+}
+
+/**
+ * Function: moveData
+ * ------------------
+ * Moves everything readable from in to out without copying it through user
+ * space: copy_file_range between two files, splice whenever a pipe is
+ * involved.  Falls back to copyThroughBuffer if neither applies.  Because
+ * both calls advance the descriptors' file offsets, the fallback can pick up
+ * exactly where they left off.
+ */
+static bool moveData(int in, int out) {
+  bool useSplice = isPipe(in) || isPipe(out);
+  bool useCopy = !useSplice && hasKnownSize(in);
+  while (useSplice || useCopy) {
+    ssize_t count = useSplice ? splice(in, NULL, out, NULL, kChunkSize, SPLICE_F_MOVE | SPLICE_F_MORE)
+                              : copy_file_range(in, NULL, out, NULL, kChunkSize, 0);
+    if (count == 0) return true;
+    if (count > 0) continue;
+    if (errno == EINTR) continue;
+    if (!isUnsupported()) return false;
+    break;
+  }
+
+  return copyThroughBuffer(in, vector<int>(1, out));
+}
+
+/**
+ * Function: spliceExactly
+ * -----------------------
+ * Moves exactly count bytes from the pipe in to out.
+ */
+static bool spliceExactly(int in, int out, size_t count) {
+  while (count > 0) {
+    ssize_t moved = splice(in, NULL, out, NULL, count, SPLICE_F_MOVE);
+    if (moved < 0 && errno == EINTR) continue;
+    if (moved <= 0) return false;
+    count -= moved;
+  }
+
+  return true;
+}
+
+/**
+ * Function: teeWithSplice
+ * -----------------------
+ * Copies standard input (a pipe) to standard output (another pipe) and to
+ * the one file behind fd.  tee duplicates whatever is buffered in the input
+ * pipe into the output pipe without consuming it, and splice then consumes
+ * the same bytes into the file, so the data is never copied to user space.
+ */
+static bool teeWithSplice(int fd) {
+  while (true) {
+    ssize_t count = tee(STDIN_FILENO, STDOUT_FILENO, kChunkSize, 0);
+    if (count == 0) return true;
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0) return false;
+    if (!spliceExactly(STDIN_FILENO, fd, count)) return false;
+  }
+}
+
+static void reportError(const char *name, const char *arg) {
+  cerr << name << ": " << arg << ": " << strerror(errno) << endl;
+}
+
+static int runCat(const command& cmd) {
+  if (cmd.count == 0) {
+    if (moveData(STDIN_FILENO, STDOUT_FILENO)) return 0;
+    reportError("cat", "-");
+    return 1;
+  }
+
+  int status = 0;
+  for (size_t i = 0; i < cmd.count; i++) {
+    const char *arg = cmd.tokens[i];
+    bool isStdin = strcmp(arg, "-") == 0;
+    int fd = isStdin ? STDIN_FILENO : open(arg, O_RDONLY);
+    if (fd < 0 || !moveData(fd, STDOUT_FILENO)) {
+      reportError("cat", arg);
+      status = 1;
+    }
+
+    if (fd >= 0 && !isStdin) close(fd);
+  }
+
+  return status;
+}
+
+static int runTee(const command& cmd) {
+  int status = 0;
+  vector<int> outs(1, STDOUT_FILENO);
+  for (size_t i = 0; i < cmd.count; i++) {
+    int fd = open(cmd.tokens[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      reportError("tee", cmd.tokens[i]);
+      status = 1;
+    } else {
+      outs.push_back(fd);
+    }
+  }
+
+  bool copied;
+  if (outs.size() == 1) {
+    copied = moveData(STDIN_FILENO, STDOUT_FILENO);
+  } else if (outs.size() == 2 && isPipe(STDIN_FILENO) && isPipe(STDOUT_FILENO)) {
+    copied = teeWithSplice(outs[1]);
+  } else {
+    copied = copyThroughBuffer(STDIN_FILENO, outs); // tee can't duplicate a pipe more than once per pass
+  }
+
+  if (!copied) {
+    reportError("tee", "-");
+    status = 1;
+  }
+
+  return status;
+}
+
+/**
+ * Function: closeInheritedDescriptors
+ * -----------------------------------
+ * Closes every descriptor above standard error.  The pipes stsh creates are
+ * close-on-exec, but a builtin stage never execs, so without this it would
+ * hold the write ends of its neighbors' pipes open and they'd never see EOF.
+ */
+static void closeInheritedDescriptors() {
+#ifdef SYS_close_range
+  if (syscall(SYS_close_range, 3U, ~0U, 0U) == 0) return;
+#endif
+  for (long fd = sysconf(_SC_OPEN_MAX) - 1; fd > STDERR_FILENO; fd--) close(fd);
+}
+
+int runBuiltinStage(const command& cmd) {
+  closeInheritedDescriptors();
+  int signals[] = {SIGCHLD, SIGINT, SIGTSTP, SIGQUIT, SIGTTIN, SIGTTOU, SIGPIPE};
+  for (int sig: signals) signal(sig, SIG_DFL); // an exec would have reset these
+  return strcmp(cmd.command, "cat") == 0 ? runCat(cmd) : runTee(cmd);
+}
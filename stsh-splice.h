@@ -0,0 +1,48 @@
+/**
+ * File: stsh-splice.h
+ * -------------------
+ * Defines stsh's builtin data-movement stages.  When a stage of a pipeline
+ * is an option-less cat or tee, as in
+ *
+ *     grep -v DEBUG < app.log | cat | tee errors.log | sort
+ *
+ * the shell doesn't exec /bin/cat or /usr/bin/tee.  The forked child runs the
+ * stage itself, and moves the data with splice, tee, and copy_file_range, so
+ * bytes travel from one pipe (or file) to the next inside the kernel and are
+ * never copied through user space.  Whenever the descriptors involved don't
+ * support those calls (a terminal, say), the stage falls back to read and write.
+ *
+ * The builtin stages still run in child processes placed in the job's
+ * process group, so job control treats them exactly like external commands.
+ */
+
+#pragma once
+#include "stsh-parser/stsh-parse.h"
+
+/**
+ * Function: setBuiltinStages
+ * --------------------------
+ * Enables or disables the builtin data-movement stages.  They're enabled
+ * by default; when disabled, cat and tee are always executed as external
+ * commands.
+ */
+void setBuiltinStages(bool enabled);
+
+/**
+ * Function: isBuiltinStage
+ * ------------------------
+ * Returns true iff builtin stages are enabled and the provided command is
+ * one of them: cat or tee with no options (a lone "-" naming standard input
+ * is allowed for cat).
+ */
+bool isBuiltinStage(const command& cmd);
+
+/**
+ * Function: runBuiltinStage
+ * -------------------------
+ * Runs the provided builtin stage, which must satisfy isBuiltinStage, in the
+ * calling process and returns its exit status.  Standard input and output
+ * should already be wired up, since every other descriptor the process
+ * holds is closed first.  Only ever called in a freshly forked child.
+ */
+int runBuiltinStage(const command& cmd);
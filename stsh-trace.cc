@@ -0,0 +1,111 @@
+/**
+ * File: stsh-trace.cc
+ * -------------------
+ * Presents the implementation of the trace functions described in
+ * stsh-trace.h.
+ */
+
+#include "stsh-trace.h"
+#include "stsh-exception.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+
+/**
+ * Type: STSHTraceEvent
+ * --------------------
+ * One recorded event; time is CLOCK_MONOTONIC, in nanoseconds.
+ */
+struct STSHTraceEvent {
+  unsigned long long time;
+  const char *name;
+  char phase;
+  size_t job;
+  pid_t pid;
+};
+
+static const size_t kTraceCapacity = 1 << 14;
+static STSHTraceEvent events[kTraceCapacity];
+static atomic<size_t> recorded(0); // slots claimed so far, which may exceed kTraceCapacity
+static atomic<size_t> dropped(0);  // events lost since the last flush
+static int tracefd = -1;
+static pid_t tracer = 0; // forked children inherit everything above, but mustn't write it out
+
+bool tracing() {
+  return tracefd != -1;
+}
+
+static void writeAll(const char *text, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(tracefd, text, length);
+    if (written < 0 && errno == EINTR) continue;
+    if (written < 0) return; // nothing more can be done for the trace
+    text += written;
+    length -= written;
+  }
+}
+
+void openTrace(const string& path) {
+  tracefd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (tracefd < 0) throw STSHException(path + ": " + strerror(errno) + ".");
+  tracer = getpid();
+  char header[128];
+  int length = snprintf(header, sizeof(header), "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"stsh\"}},\n",
+                        getpid());
+  writeAll(header, length);
+  atexit(flushTrace);
+}
+
+void traceEvent(const char *name, char phase, size_t job, pid_t pid, const timespec *when) {
+  if (tracefd == -1) return;
+  timespec now;
+  if (when != NULL) now = *when;
+  else clock_gettime(CLOCK_MONOTONIC, &now);
+  size_t slot = recorded.fetch_add(1, memory_order_relaxed);
+  if (slot >= kTraceCapacity) {
+    dropped.fetch_add(1, memory_order_relaxed);
+    return;
+  }
+
+  STSHTraceEvent& event = events[slot];
+  event.time = now.tv_sec * 1000000000ULL + now.tv_nsec;
+  event.name = name;
+  event.phase = phase;
+  event.job = job;
+  event.pid = pid;
+}
+
+void maybeFlushTrace() {
+  if (recorded.load(memory_order_relaxed) >= kTraceCapacity / 2) flushTrace();
+}
+
+void flushTrace() {
+  if (tracefd == -1 || getpid() != tracer) return;
+  size_t count = min(recorded.load(memory_order_relaxed), kTraceCapacity);
+  string text;
+  char line[192];
+  for (size_t i = 0; i < count; i++) {
+    const STSHTraceEvent& event = events[i];
+    int length = snprintf(line, sizeof(line),
+                          "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":0,%s\"args\":{\"job\":%zu,\"pid\":%d}},\n",
+                          event.name, event.phase, event.time / 1000, event.time % 1000, tracer,
+                          event.phase == 'i' ? "\"s\":\"t\"," : "", event.job, event.pid);
+    text.append(line, length);
+  }
+
+  size_t lost = dropped.exchange(0, memory_order_relaxed);
+  if (lost > 0) {
+    int length = snprintf(line, sizeof(line), "{\"name\":\"dropped\",\"ph\":\"i\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":0,\"s\":\"g\",\"args\":{\"events\":%zu}},\n",
+                          events[count - 1].time / 1000, events[count - 1].time % 1000, tracer, lost);
+    text.append(line, length);
+  }
+
+  recorded.store(0, memory_order_relaxed);
+  writeAll(text.data(), text.size());
+}
@@ -0,0 +1,95 @@
+/**
+ * File: stsh-trace.h
+ * ------------------
+ * Defines stsh's trace mode, which records when each line was read and
+ * parsed, when each job was launched and each of its processes started,
+ * when the shell waited on a job, and when each child was reaped, stopped,
+ * or continued, so it's possible to see where the time between pressing
+ * Enter and seeing the first output goes.
+ *
+ * Events are written in Chrome's trace event format, one event per line:
+ *
+ *     [
+ *     {"name":"read","ph":"B","ts":1021.733,"pid":4711,"tid":0,"args":{"job":0,"pid":0}},
+ *     {"name":"read","ph":"E","ts":2874.051,"pid":4711,"tid":0,"args":{"job":0,"pid":0}},
+ *
+ * so the file can be processed a line at a time, and also loaded as is by
+ * chrome://tracing or Perfetto, both of which accept a file whose closing
+ * bracket is missing.  Timestamps are CLOCK_MONOTONIC, in microseconds.
+ *
+ * Events are recorded into a fixed-size in-memory buffer, and only written
+ * out when the shell is about to wait for input anyway, between the lines
+ * of a script once the buffer is half full, and when the shell exits.
+ * Recording an event is a clock read and an atomic increment, cheap enough
+ * not to distort what's being measured.  Events are only recorded from the
+ * main flow of control: the SIGCHLD handler leaves its timestamps in the
+ * child event ring, and they're recorded once the ring is drained.
+ */
+
+#pragma once
+#include <string>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * Function: openTrace
+ * -------------------
+ * Starts tracing to the named file, which is truncated.  Throws an
+ * STSHException if it can't be opened.
+ */
+void openTrace(const std::string& path);
+
+/**
+ * Function: tracing
+ * -----------------
+ * Returns true iff openTrace has succeeded.
+ */
+bool tracing();
+
+/**
+ * Function: traceEvent
+ * --------------------
+ * Records an event of the provided phase ('B' to begin a span, 'E' to end
+ * it, or 'i' for an instant), named by a string literal, and concerning the
+ * provided job and process (0 if none).  The event is stamped with the
+ * current time, unless when supplies the (CLOCK_MONOTONIC) time it actually
+ * happened.  Does nothing unless tracing.  Events that arrive when the
+ * buffer is full are counted and dropped.  Not to be called from a signal
+ * handler, since flushTrace empties the buffer without blocking any.
+ */
+void traceEvent(const char *name, char phase, size_t job = 0, pid_t pid = 0, const timespec *when = NULL);
+
+/**
+ * Function: flushTrace
+ * --------------------
+ * Writes every event recorded so far to the trace file.  Never called from
+ * a signal handler.  Does nothing in a forked child, so a child that exits
+ * before it execs doesn't write out a copy of the shell's events.
+ */
+void flushTrace();
+
+/**
+ * Function: maybeFlushTrace
+ * -------------------------
+ * Calls flushTrace if the buffer is at least half full.
+ */
+void maybeFlushTrace();
+
+/**
+ * Type: STSHTraceSpan
+ * -------------------
+ * Records a begin event when constructed and the matching end event when
+ * destroyed, so a span covers a scope however it's left.
+ */
+class STSHTraceSpan {
+public:
+  STSHTraceSpan(const char *name, size_t job = 0) : name(name), job(job) { traceEvent(name, 'B', job); }
+  ~STSHTraceSpan() { traceEvent(name, 'E', job); }
+
+private:
+  const char *name;
+  size_t job;
+
+  STSHTraceSpan(const STSHTraceSpan& original) = delete;
+  STSHTraceSpan& operator=(const STSHTraceSpan& rhs) = delete;
+};
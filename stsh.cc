@@ -10,40 +10,177 @@
 #include "stsh-signal.h"
 #include "stsh-job-list.h"
 #include "stsh-job.h"
+#include "stsh-parse-utils.h"
 #include "stsh-process.h"
+#include "stsh-launch.h"
+#include "stsh-events.h"
+#include "stsh-path-cache.h"
+#include "stsh-splice.h"
+#include "stsh-builtins.h"
+#include "stsh-placement.h"
+#include "stsh-cgroup.h"
+#include "stsh-priority.h"
+#include "stsh-ring.h"
+#include "stsh-trace.h"
+#include "string-utils.h"
 #include <array>
+#include <cerrno>
 #include <cstring>
 #include <iostream>
 #include <string>
 #include <algorithm>
+#include <memory>
+#include <vector>
 #include <assert.h>
 #include <fcntl.h>
 #include <unistd.h>  // for fork
 #include <signal.h>  // for kill
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifndef P_PIDFD
+#define P_PIDFD 3 // waitid id type for pidfds, missing from older glibc headers
+#endif
 #include "fork-utils.h" // this needs to be the last #include in the list
 using namespace std;
 
 static STSHJobList joblist; // the one piece of global data we need so signal handlers can access it
+static STSHEventLoop events; // only opened when stsh runs with --event-loop
+static STSHPathCache paths; // where each command has been found along $PATH
+static bool trackingChildren = true; // true iff every child is being watched through a pidfd
+static size_t defaultPipeSize = 0; // capacity of the pipes between stages (set by --pipe-size), or 0 for the kernel's
+static STSHPlacement defaultPlacement; // where the stages of every job run (set by --placement)
+static STSHPriority backgroundPriority; // how background jobs are demoted (set by --demote-bg), if at all
+static bool ownsTerminal = isatty(STDIN_FILENO); // false when run with stdin redirected, so tcsetpgrp is skipped
+static volatile sig_atomic_t interruptPending = 0; // set by a SIGINT that had no foreground job to go to
+static int lastStatus = 0; // exit status of the most recent pipeline (see runPipelines)
 
-static void waitForFg(){
-  // stop the program to run what is in the foreground
-  // Block all signals except for sigchild
+static void dispatchEvents(bool watchInput, bool& inputReady);
+static void drainChildEvents();
+static size_t launchJob(const pipeline& p, bool background, bool announce);
+static void loadScriptFile(const string& path, vector<unique_ptr<pipeline>>& pipelines);
+
+/**
+ * Function: blockJobListSignals
+ * -----------------------------
+ * Blocks SIGCHLD, along with SIGINT and SIGTSTP, whose handler consults the
+ * job list to find the foreground job, and stores the previous mask in
+ * existing.  Held whenever the main loop changes the job list, so no
+ * handler ever sees it half-updated.
+ */
+static void blockJobListSignals(sigset_t& existing) {
   sigset_t mask;
   sigemptyset(&mask);
-  while(joblist.hasForegroundJob()) {
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTSTP);
+  sigprocmask(SIG_BLOCK, &mask, &existing);
+}
+
+/**
+ * Function: waitForEvents
+ * -----------------------
+ * Blocks until at least one signal has been handled, either by an
+ * asynchronous signal handler or, in event-loop mode, by dispatchEvents.
+ */
+static void waitForEvents() {
+  if (events.isOpen()) {
+    bool inputReady;
+    dispatchEvents(false, inputReady);
+  } else {
+    sigset_t mask;
+    sigemptyset(&mask);
     sigsuspend(&mask);
   }
 }
 
+/**
+ * Function: waitUntil
+ * -------------------
+ * Waits for events until done returns true.  SIGCHLD stays blocked while
+ * done is being evaluated (sigsuspend unblocks it atomically), so a child
+ * can't change state between the check and the wait and leave us asleep.
+ * Whatever the SIGCHLD handler collected is applied before each check.
+ */
+template <typename Predicate>
+static void waitUntil(Predicate done) {
+  sigset_t mask, existing;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &mask, &existing);
+  while (drainChildEvents(), !done()) {
+    waitForEvents();
+  }
+
+  sigprocmask(SIG_SETMASK, &existing, NULL);
+}
+
+static void waitForFg(){
+  // stop the program to run what is in the foreground
+  waitUntil([] { return !joblist.hasForegroundJob(); });
+}
+
 /**
  * Builtin Handlers
  * -----------------------
  */
+
+/**
+ * Function: getToken
+ * ------------------
+ * Returns the index'th argument of the pipeline's leading command,
+ * or NULL if there are fewer than index + 1 arguments.
+ */
+static char *getToken(const pipeline& p, size_t index) {
+  const command& cmd = p.commands[0];
+  return index < cmd.count ? cmd.tokens[index] : NULL;
+}
+/**
+ * Function: changePriority
+ * ------------------------
+ * Applies the provided scheduling settings to every stage of the provided
+ * job that hasn't exited, warning on behalf of builtin if they couldn't all
+ * be applied.
+ */
+static void changePriority(const STSHJob& job, const STSHPriority& priority, const string& builtin) {
+  vector<pid_t> pids;
+  for (const STSHProcess& process: job.getProcesses()) {
+    if (process.getState() != kTerminated) pids.push_back(process.getID());
+  }
+
+  if (!applyGroupPriority(job.getGroupID(), pids, priority)) {
+    cerr << builtin << " " << job.getNum() << ": Couldn't change priority: " << strerror(errno) << "." << endl;
+  }
+}
+
+/**
+ * Function: updatePriority
+ * ------------------------
+ * With --demote-bg, demotes a job that bg is moving to the background, and
+ * restores the interactive settings of a demoted job that fg is moving to the
+ * foreground.  Only the settings the demotion changes are restored, and jobs
+ * launched with settings of their own are left alone.
+ */
+static void updatePriority(STSHJob& job, const string& builtin) {
+  if (builtin == "bg" && !backgroundPriority.empty() && job.getPriority() == kInteractivePriority) {
+    changePriority(job, backgroundPriority, builtin);
+    job.setPriority(kDemotedPriority);
+  } else if (builtin == "fg" && job.getPriority() == kDemotedPriority) {
+    STSHPriority interactive = getInteractivePriority();
+    interactive.hasNice = backgroundPriority.hasNice;
+    interactive.hasIOPriority = backgroundPriority.hasIOPriority;
+    interactive.hasPolicy = backgroundPriority.hasPolicy;
+    changePriority(job, interactive, builtin);
+    job.setPriority(kInteractivePriority);
+  }
+}
+
 static void fgbgHandler(const pipeline& p, string builtin, int sig){
   // Get the inputs and do error checking
-  char* token0 = p.commands[0].tokens[0];
-  char* token1 = p.commands[0].tokens[1];
+  char* token0 = getToken(p, 0);
+  char* token1 = getToken(p, 1);
   
   int t0 = 0;
   if (token0 != NULL) {  
@@ -58,13 +195,19 @@ static void fgbgHandler(const pipeline& p, string builtin, int sig){
       // IF there were no errors, get the job with #t0 from the job list
       STSHJob& job = joblist.getJob(t0);
       pid_t groupID = job.getGroupID();
+      updatePriority(job, builtin); // before the job resumes
+      traceEvent(builtin == "fg" ? "fg" : "bg", 'i', t0, groupID);
       kill(-groupID, sig);      
-      job.setState(kForeground);
+      sigset_t existing;
+      blockJobListSignals(existing);
+      joblist.setState(job, builtin == "fg" ? kForeground : kBackground);
+      sigprocmask(SIG_SETMASK, &existing, NULL);
     
       if (builtin == "fg") {
-        if (tcsetpgrp(STDIN_FILENO, groupID) < 0) {
+        if (ownsTerminal && tcsetpgrp(STDIN_FILENO, groupID) < 0) {
           throw STSHException("Failed to transfer STDIN control to foreground process.");
         } 
+        STSHTraceSpan wait("wait", t0);
         waitForFg();
       }    
     }
@@ -73,9 +216,9 @@ static void fgbgHandler(const pipeline& p, string builtin, int sig){
 
 static void singleProcessHandler(const pipeline& p, string builtin, int sig){
   // Get the inputs and do error checking
-  char* token0 = p.commands[0].tokens[0];
-  char* token1 = p.commands[0].tokens[1];
-  char* token2 = p.commands[0].tokens[2];
+  char* token0 = getToken(p, 0);
+  char* token1 = getToken(p, 1);
+  char* token2 = getToken(p, 2);
 
   int t0 = 0;
   if (token0 != NULL) {
@@ -118,72 +261,274 @@ static void singleProcessHandler(const pipeline& p, string builtin, int sig){
   }
 }
 
+/**
+ * Function: parallelHandler
+ * -------------------------
+ * Runs every command line in a file as its own background job, keeping at
+ * most n of those jobs running at once, and returns once all of them have
+ * finished.  The file is named either by an argument or by redirecting
+ * input, as with
+ *
+ *     parallel -j 8 commands.txt
+ *     parallel -j 8 < commands.txt
+ *
+ * and n defaults to the number of online CPUs.  Lines are read exactly as
+ * script lines are, and each is launched as an external pipeline (even if
+ * it names a builtin) whose standard input, unless redirected, is /dev/null,
+ * so no job can stop by reading from the terminal.  A ctrl-c stops any more
+ * jobs from being launched and is passed along to the ones still running.
+ */
+static void parallelHandler(const pipeline& p) {
+  static const string kUsage = "Usage: parallel [-j <n>] <file> | parallel [-j <n>] < <file>.";
+  size_t limit = max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+  size_t next = 0;
+  char *option = getToken(p, next);
+  if (option != NULL && strcmp(option, "-j") == 0) {
+    limit = parseNumber(getToken(p, next + 1), kUsage);
+    next += 2;
+  }
+
+  string path = p.input;
+  if (getToken(p, next) != NULL) path = getToken(p, next++);
+  if (limit == 0 || path.empty() || (!p.input.empty() && path != p.input) ||
+      getToken(p, next) != NULL || p.commands.size() > 1 || !p.output.empty()) {
+    throw STSHException(kUsage);
+  }
+
+  vector<unique_ptr<pipeline>> pipelines;
+  loadScriptFile(path, pipelines);
+  interruptPending = 0;
+  vector<size_t> running;
+  auto finished = [&running] (size_t num) { return !joblist.containsJob(num); };
+  for (const unique_ptr<pipeline>& q: pipelines) {
+    waitUntil([&] {
+      running.erase(remove_if(running.begin(), running.end(), finished), running.end());
+      return running.size() < limit || interruptPending;
+    });
+
+    if (interruptPending) break;
+    if (q->input.empty() && q->hereString.empty()) q->input = "/dev/null";
+    size_t num = launchJob(*q, /* background = */ true, /* announce = */ false);
+    if (num != 0) running.push_back(num);
+  }
+
+  while (true) {
+    waitUntil([&] {
+      running.erase(remove_if(running.begin(), running.end(), finished), running.end());
+      return running.empty() || interruptPending;
+    });
+
+    if (running.empty()) break;
+    interruptPending = 0;
+    for (size_t num: running) {
+      if (joblist.containsJob(num)) kill(-joblist.getJob(num).getGroupID(), SIGINT);
+    }
+  }
+}
+
+/**
+ * Function: hashHandler
+ * ---------------------
+ * Inspects and manages the table of remembered command paths:
+ *
+ *     hash                lists every remembered path and how often it's been used
+ *     hash -r             forgets every remembered path
+ *     hash -d <name> ...  forgets the paths of the named commands
+ *     hash <name> ...     looks up and remembers the paths of the named commands
+ */
+static void hashHandler(const pipeline& p) {
+  char *first = getToken(p, 0);
+  if (first == NULL) {
+    if (paths.empty()) {
+      cout << "hash: hash table empty" << endl;
+    } else {
+      cout << paths;
+    }
+    return;
+  }
+
+  if (strcmp(first, "-r") == 0) {
+    if (getToken(p, 1) != NULL) throw STSHException("Usage: hash [-r] | hash [-d] <name> ....");
+    paths.clear();
+    return;
+  }
+
+  bool forget = strcmp(first, "-d") == 0;
+  size_t i = forget ? 1 : 0;
+  if (getToken(p, i) == NULL) throw STSHException("Usage: hash [-r] | hash [-d] <name> ....");
+  for (char *name; (name = getToken(p, i)) != NULL; i++) {
+    bool found = forget ? paths.forget(name) : !paths.resolve(name).empty();
+    if (!found) cerr << "hash: " << name << ": not found" << endl;
+  }
+}
+
+/**
+ * Function: exitHandler
+ * ---------------------
+ * Exits stsh on behalf of quit or exit, with the provided status if there
+ * is one, and otherwise with that of the most recent pipeline.
+ */
+static void exitHandler(const pipeline& p, const string& builtin) {
+  const string usage = "Usage: " + builtin + " [<status>].";
+  char *token0 = getToken(p, 0);
+  if (getToken(p, 1) != NULL) throw STSHException(usage);
+  exit(token0 == NULL ? lastStatus : parseNumber(token0, usage) & 0xff);
+}
+
+/**
+ * Function: usageHandler
+ * ----------------------
+ * Reports the resource usage of jobs, stage by stage:
+ *
+ *     usage           reports every recently finished job
+ *     usage <jobid>   reports the specified job, whether or not it's finished
+ */
+static void usageHandler(const pipeline& p) {
+  char *token0 = getToken(p, 0);
+  if (token0 == NULL) {
+    for (const STSHJob& job: joblist.getFinishedJobs()) reportUsage(cout, job);
+    return;
+  }
+
+  size_t num = parseNumber(token0, "Usage: usage [<jobid>].");
+  if (getToken(p, 1) != NULL) throw STSHException("Usage: usage [<jobid>].");
+  if (joblist.containsJob(num)) {
+    reportUsage(cout, joblist.getJob(num));
+  } else if (joblist.containsFinishedJob(num)) {
+    reportUsage(cout, joblist.getFinishedJob(num));
+  } else {
+    throw STSHException("usage " + to_string(num) + ": No such job.");
+  }
+}
+
+/**
+ * Function: pinHandler
+ * --------------------
+ * Moves the processes of a running job onto the CPUs named by a placement
+ * (see stsh-placement.h), stage by stage, as though the job had been
+ * launched with it.  "none" lets them run anywhere the shell may again.
+ * Memory already allocated stays where it is.
+ */
+static void pinHandler(const pipeline& p) {
+  static const string kUsage = "Usage: pin <jobid> <placement>.";
+  char *token0 = getToken(p, 0);
+  char *token1 = getToken(p, 1);
+  if (token0 == NULL || token1 == NULL || getToken(p, 2) != NULL) throw STSHException(kUsage);
+  size_t num = parseNumber(token0, kUsage);
+  if (!joblist.containsJob(num)) throw STSHException("pin " + to_string(num) + ": No such job.");
+  STSHPlacement placement = parsePlacement(token1);
+  if (placement.kind == STSHPlacement::kNone) {
+    placement.kind = STSHPlacement::kCPUs; // every CPU, which planPlacement narrows to the shell's own
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, &placement.cpus);
+  }
+
+  const vector<STSHProcess>& processes = joblist.getJob(num).getProcesses();
+  vector<STSHStagePlacement> stages = planPlacement(placement, processes.size());
+  for (size_t i = 0; i < processes.size(); i++) {
+    if (processes[i].getState() == kTerminated) continue;
+    if (!movePlacement(processes[i].getID(), stages[i])) {
+      cerr << "pin: " << processes[i].getID() << ": " << strerror(errno) << endl;
+    }
+  }
+}
+
+/**
+ * Function: limitHandler
+ * ----------------------
+ * Lists or changes the limits on a job's control group (see stsh-cgroup.h):
+ *
+ *   limit <jobid>                          lists its cpu, memory, and io limits
+ *   limit <jobid> cpu <percent>%|max       caps its CPU time, where 100% is one CPU
+ *   limit <jobid> memory <size>|max        caps its memory
+ *   limit <jobid> io <major:minor> <key=value> ...  sets its io.max for a device
+ */
+static void limitHandler(const pipeline& p) {
+  static const string kUsage = "Usage: limit <jobid> [cpu <percent>%|max | memory <size>|max | io <device> <limits>].";
+  static const size_t kCPUPeriod = 100000; // microseconds
+  char *token0 = getToken(p, 0);
+  if (token0 == NULL) throw STSHException(kUsage);
+  size_t num = parseNumber(token0, kUsage);
+  if (!joblist.containsJob(num)) throw STSHException("limit " + to_string(num) + ": No such job.");
+  const string& cgroup = joblist.getJob(num).getCgroup();
+  if (cgroup.empty()) throw STSHException("limit " + to_string(num) + ": Job isn't contained (see --cgroups).");
+
+  char *resource = getToken(p, 1);
+  if (resource == NULL) {
+    for (const char *name: {"cpu", "memory", "io"}) cout << name << ": " << getCgroupLimit(cgroup, name) << endl;
+    return;
+  }
+
+  char *value = getToken(p, 2);
+  if (value == NULL) throw STSHException(kUsage);
+  string limit = value;
+  if (strcmp(resource, "cpu") == 0 && limit != "max") {
+    if (limit.empty() || limit.back() != '%') throw STSHException(kUsage);
+    limit.pop_back();
+    size_t percent = parseNumber(limit.c_str(), kUsage);
+    limit = to_string(max<size_t>(percent * kCPUPeriod / 100, 1000)); // the kernel's minimum quota is 1ms
+  } else if (strcmp(resource, "memory") == 0 && limit != "max") {
+    limit = to_string(parseSize(value, kUsage));
+  } else if (strcmp(resource, "io") == 0) {
+    for (size_t i = 3; getToken(p, i) != NULL; i++) limit += string(" ") + getToken(p, i);
+  }
+
+  if (strcmp(resource, "cpu") == 0) limit += " " + to_string(kCPUPeriod);
+  if (strcmp(resource, "io") != 0 && getToken(p, 3) != NULL) throw STSHException(kUsage);
+  setCgroupLimit(cgroup, resource, limit);
+}
+
+/**
+ * Function: registerBuiltins
+ * --------------------------
+ * Registers every builtin stsh supports.  Adding a builtin is just a
+ * matter of adding a line here.
+ */
+static STSHBuiltinTable builtins;
+static void registerBuiltins() {
+  builtins.add("quit", [](const pipeline& p) { exitHandler(p, "quit"); });
+  builtins.add("exit", [](const pipeline& p) { exitHandler(p, "exit"); });
+  builtins.add("fg", [](const pipeline& p) { fgbgHandler(p, "fg", SIGCONT); });
+  builtins.add("bg", [](const pipeline& p) { fgbgHandler(p, "bg", SIGCONT); });
+  builtins.add("slay", [](const pipeline& p) { singleProcessHandler(p, "slay", SIGKILL); });
+  builtins.add("halt", [](const pipeline& p) { singleProcessHandler(p, "halt", SIGSTOP); });
+  builtins.add("cont", [](const pipeline& p) { singleProcessHandler(p, "cont", SIGCONT); });
+  builtins.add("jobs", [](const pipeline& p) { cout << joblist; });
+  builtins.add("parallel", parallelHandler);
+  builtins.add("hash", hashHandler);
+  builtins.add("usage", usageHandler);
+  builtins.add("pin", pinHandler);
+  builtins.add("limit", limitHandler);
+}
+
 /**
  * Function: handleBuiltin
  * -----------------------
  * Examines the leading command of the provided pipeline to see if
  * it's a shell builtin, and if so, handles and executes it.  handleBuiltin
- * returns true if the command is a builtin, and false otherwise.
+ * returns true if the command is a builtin, and false otherwise.  Builtins
+ * report misuse by throwing STSHExceptions, which are left to the caller.
+ * Builtins run within the shell itself, so none of the line prefixes apply
+ * to them, and a builtin given any is rejected rather than run without them.
  */
-static const string kSupportedBuiltins[] = {"quit", "exit", "fg", "bg", "slay", "halt", "cont", "jobs"};
-static const size_t kNumSupportedBuiltins = sizeof(kSupportedBuiltins)/sizeof(kSupportedBuiltins[0]);
 static bool handleBuiltin(const pipeline& pipeline) {
-  const string& command = pipeline.commands[0].command;
-  auto iter = find(kSupportedBuiltins, kSupportedBuiltins + kNumSupportedBuiltins, command);
-  if (iter == kSupportedBuiltins + kNumSupportedBuiltins) return false;
-  size_t index = iter - kSupportedBuiltins;
-
-  switch (index) {
-  case 0:
-  case 1: exit(0);
-  case 2: // fg
-    try {
-      fgbgHandler(pipeline, "fg", SIGCONT);
-    } catch (const STSHException& e) {
-      cerr << e.what() << endl;
-    }
-    break;
-  case 3: // bg
-    try {
-      fgbgHandler(pipeline, "bg", SIGCONT);
-    } catch (const STSHException& e) {
-      cerr << e.what() << endl;
-    }
-    break;
-  case 4: // slay 
-    try {
-      singleProcessHandler(pipeline, "slay", SIGKILL);
-    } catch (const STSHException& e) {
-      cerr << e.what() << endl;
-    }
-    break;
-  case 5: // halt
-    try {
-      singleProcessHandler(pipeline, "halt", SIGSTOP);
-    } catch (const STSHException& e) {
-      cerr << e.what() << endl;
-    }
-    break; 
-  case 6: // cont
-    try {
-      singleProcessHandler(pipeline, "cont", SIGCONT);
-    } catch (const STSHException& e) {
-      cerr << e.what() << endl;
-    }
-    break;
-  case 7: cout << joblist; break;
-  default: throw STSHException("Internal Error: Builtin command not supported."); // or not implemented yet
+  STSHBuiltinHandler handler = builtins.lookup(pipeline.commands[0].command);
+  if (handler == NULL) return false;
+  if (pipeline.timed || pipeline.pipeSize != 0 || !pipeline.placement.empty() || !pipeline.priority.empty()) {
+    throw STSHException(string(pipeline.commands[0].command) + ": Builtins can't be prefixed with time, pipesize=, placement=, nice=, ionice=, or sched=.");
   }
-  
+
+  handler(pipeline);
   return true;
 }
 
-static void updateJobList(STSHJobList& jobList, pid_t pid, STSHProcessState state) {
+static void updateJobList(STSHJobList& jobList, pid_t pid, STSHProcessState state, const struct rusage *usage,
+                          int status, const timespec& reaped) {
      if (!jobList.containsProcess(pid)) return;
      STSHJob& job = jobList.getJobWithProcess(pid);
      assert(job.containsProcess(pid));
      STSHProcess& process = job.getProcess(pid);
      process.setState(state);
+     if (usage != NULL) process.recordExit(*usage, status, reaped);
      jobList.synchronize(job);
 }
 
@@ -191,40 +536,292 @@ static void updateJobList(STSHJobList& jobList, pid_t pid, STSHProcessState stat
  * -------------------------------
  */
 
+/* Type: StateChange
+ * -------------------------------
+ * A single state change gathered while reaping, along with the
+ * CLOCK_MONOTONIC time it was collected.  usage and status are only
+ * meaningful when state is kTerminated, in which case they hold the
+ * resource usage the kernel reported for the reaped child and its exit
+ * status.
+ */
+struct StateChange {
+  pid_t pid;
+  STSHProcessState state;
+  timespec when;
+  struct rusage usage;
+  int status;
+};
+
+typedef vector<StateChange> StateChanges;
+
+static void addStateChange(StateChanges& changes, pid_t pid, STSHProcessState state, const timespec& when,
+                           const struct rusage *usage = NULL, int status = 0) {
+  StateChange change;
+  change.pid = pid;
+  change.state = state;
+  change.when = when;
+  change.status = status;
+  if (usage != NULL) change.usage = *usage;
+  changes.push_back(change);
+}
+
+/* Function: traceStateChange
+ * -------------------------------
+ * Records, when tracing, a state change that's about to be applied, as of
+ * the time it was collected, and with the number of the job it belongs to.
+ */
+static void traceStateChange(const StateChange& change) {
+  if (!tracing()) return;
+  const char *name = change.state == kTerminated ? "exited" : change.state == kStopped ? "stopped" : "continued";
+  size_t num = joblist.containsProcess(change.pid) ? joblist.getJobWithProcess(change.pid).getNum() : 0;
+  traceEvent(name, 'i', num, change.pid, &change.when);
+}
+
+/* Function: applyStateChanges
+ * -------------------------------
+ * Feeds a batch of state changes gathered while reaping into the job list,
+ * and then takes the terminal back if that batch left us without a
+ * foreground job.
+ */
+static void applyStateChanges(const StateChanges& changes) {
+  bool lostForeground = false;
+  for (const StateChange& change: changes) {
+    bool exited = change.state == kTerminated;
+    traceStateChange(change);
+    updateJobList(joblist, change.pid, change.state, exited ? &change.usage : NULL, change.status, change.when);
+    if (change.state != kRunning) lostForeground = true;
+  }
+
+  if (lostForeground && ownsTerminal && !joblist.hasForegroundJob()) {
+    if (tcsetpgrp(STDIN_FILENO, getpid()) < 0) {
+      throw STSHException("Failed to transfer STDIN control back to terminal.");
+    }
+  }
+}
+
+/* Type: ChildEvent
+ * -------------------------------
+ * Everything wait4 reported about one child, as recorded by the SIGCHLD
+ * handler for the main loop to make sense of later, along with the
+ * CLOCK_MONOTONIC time wait4 reported it (which may be well before the
+ * main loop gets to it).
+ */
+struct ChildEvent {
+  pid_t pid;
+  int status;
+  struct rusage usage;
+  timespec when;
+};
+
+static STSHRing<ChildEvent, 256> childEvents; // filled by sigChild, drained by drainChildEvents
+static volatile sig_atomic_t childEventsOverflowed = 0; // set when sigChild left children unreaped for lack of room
+
+/* Function: addWaitStatus
+ * -------------------------------
+ * Records the state change described by a status reported by wait4.
+ */
+static void addWaitStatus(StateChanges& changes, const ChildEvent& event) {
+  if (WIFEXITED(event.status) || WIFSIGNALED(event.status)) {
+    int status = WIFEXITED(event.status) ? WEXITSTATUS(event.status) : 128 + WTERMSIG(event.status);
+    addStateChange(changes, event.pid, kTerminated, event.when, &event.usage, status);
+  } else if (WIFSTOPPED(event.status)) {
+    addStateChange(changes, event.pid, kStopped, event.when);
+  } else { // WIFCONTINUED(status)
+    addStateChange(changes, event.pid, kRunning, event.when);
+  }
+}
+
+/* Function: collectChildren
+ * -------------------------------
+ * Reaps every child with a pending state change and records those changes,
+ * along with the resource usage of every child that exited.
+ */
+static void collectChildren(StateChanges& changes) {
+  while (true) {
+    ChildEvent event;
+    event.pid = wait4(-1, &event.status, WNOHANG | WUNTRACED | WCONTINUED, &event.usage);
+    if (event.pid <= 0) break;
+    clock_gettime(CLOCK_MONOTONIC, &event.when);
+    addWaitStatus(changes, event);
+  }
+}
+
+/* Function: collectStoppedAndContinued
+ * -------------------------------
+ * Records children that have stopped or continued, without reaping any
+ * that have exited (those are reaped through their pidfds instead).
+ */
+static void collectStoppedAndContinued(StateChanges& changes) {
+  while (true) {
+    siginfo_t info;
+    info.si_pid = 0;
+    if (waitid(P_ALL, 0, &info, WSTOPPED | WCONTINUED | WNOHANG) < 0 || info.si_pid == 0) break;
+    timespec when;
+    clock_gettime(CLOCK_MONOTONIC, &when);
+    addStateChange(changes, info.si_pid, info.si_code == CLD_CONTINUED ? kRunning : kStopped, when);
+  }
+}
+
+/* Function: collectExited
+ * -------------------------------
+ * Reaps the child behind a pidfd that epoll reported as ready.  The raw
+ * waitid system call is used because, unlike the glibc wrapper, it also
+ * reports the child's resource usage.
+ */
+static void collectExited(const STSHEvent& event, StateChanges& changes) {
+  siginfo_t info;
+  info.si_pid = 0;
+  struct rusage usage;
+  int result = syscall(SYS_waitid, P_PIDFD, event.pidfd, &info, WEXITED | WNOHANG, &usage);
+  if (result == 0 && info.si_pid == 0) return; // hasn't actually exited yet
+  if (result == 0) {
+    timespec when;
+    clock_gettime(CLOCK_MONOTONIC, &when);
+    int status = info.si_code == CLD_EXITED ? info.si_status : 128 + info.si_status;
+    addStateChange(changes, event.pid, kTerminated, when, &usage, status);
+  }
+
+  events.unwatchChild(event.pidfd); // on ECHILD, a waitpid sweep already reaped it
+}
+
+/* Function: drainChildEvents
+ * -------------------------------
+ * Applies, as a single batch, every state change the SIGCHLD handler has
+ * collected since the last call.  If the handler ran out of room, the
+ * children it had to leave behind are reaped here instead.  SIGCHLD is
+ * blocked throughout, so changes are applied in the order they happened,
+ * and so are SIGINT and SIGTSTP, so they're never forwarded on the basis of
+ * a job list that's only been partly updated.
+ */
+static void drainChildEvents() {
+  sigset_t existing;
+  blockJobListSignals(existing);
+  StateChanges changes;
+  ChildEvent event;
+  while (childEvents.pop(event)) addWaitStatus(changes, event);
+  if (childEventsOverflowed) {
+    childEventsOverflowed = 0;
+    collectChildren(changes);
+  }
+
+  try {
+    applyStateChanges(changes);
+  } catch (const STSHException& e) {
+    cerr << e.what() << endl;
+  }
+
+  sigprocmask(SIG_SETMASK, &existing, NULL);
+}
+
+/* Function: forwardSignal
+ * -------------------------------
+ * Pass a signal to the foreground process
+ */
+static void forwardSignal(int sig) {
+  if(joblist.hasForegroundJob()){
+    pid_t groupID = joblist.getForegroundJob().getGroupID();
+    kill(-groupID, sig);
+  } else if (sig == SIGINT) {
+    interruptPending = 1; // picked up by parallelHandler, if it's running
+  }
+}
+
 /* Function: sigChild
  * -------------------------------
- * sigChildReaps our child process and removes jobs from the job list
+ * Asynchronous SIGCHLD handler.  It only reaps, recording what wait4
+ * reports in childEvents, and leaves the job list to drainChildEvents, so
+ * it never runs into the main loop halfway through changing it.  It stops
+ * reaping when the ring is full, so nothing is lost: the children it
+ * leaves behind stay waitable until drainChildEvents gets to them.
  */
 static void sigChild(int sig){
+  int saved = errno; // wait4 may clobber it under the interrupted code
   while (true) {
-    int status;
-    pid_t pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED); 
-    if (pid <= 0) break;
-     
-    if (WIFEXITED(status) || WIFSIGNALED(status)) {
-       updateJobList(joblist, pid, kTerminated);
-       if (tcsetpgrp(STDIN_FILENO, getpid()) < 0) {
-         throw STSHException("Failed to transfer STDIN control back to terminal.");
-       }
-    } else if(WIFSTOPPED(status)) {
-       updateJobList(joblist, pid, kStopped);
-       if (tcsetpgrp(STDIN_FILENO, getpid()) < 0) {
-         throw STSHException("Failed to transfer STDIN control back to terminal.");
-       } 
-    } else { // WIFCONTINUED(status)
-      updateJobList(joblist, pid, kRunning);
+    if (childEvents.full()) {
+      childEventsOverflowed = 1;
+      break;
     }
+
+    ChildEvent event;
+    event.pid = wait4(-1, &event.status, WNOHANG | WUNTRACED | WCONTINUED, &event.usage);
+    if (event.pid <= 0) break;
+    clock_gettime(CLOCK_MONOTONIC, &event.when); // async-signal-safe
+    childEvents.push(event);
   }
+
+  errno = saved;
 }
 
 /* Function: sigForward
  * -------------------------------
- * Pass a signal to the foreground process
+ * Asynchronous SIGINT and SIGTSTP handler
  */
 static void sigForward(int sig){
-  if(joblist.hasForegroundJob()){
-    pid_t groupID = joblist.getForegroundJob().getGroupID();
-    kill(-groupID, sig);
+  forwardSignal(sig);
+}
+
+/* Function: dispatchEvents
+ * -------------------------------
+ * Event-loop counterpart to the handlers above: waits for the next batch
+ * of events and handles every signal in it.  Children that have exited are
+ * reaped individually through their pidfds, and SIGCHLD is only used to
+ * learn about children that stopped or continued (unless pidfds aren't
+ * available, in which case a SIGCHLD triggers a full waitpid sweep).  All
+ * resulting state changes are fed into the job list as a single batch.
+ * inputReady is set to true iff watchInput is true and standard input has
+ * become readable.
+ */
+static void dispatchEvents(bool watchInput, bool& inputReady) {
+  vector<STSHEvent> batch;
+  events.wait(batch, watchInput);
+  inputReady = false;
+  bool childrenChanged = false;
+  StateChanges changes;
+  for (const STSHEvent& event: batch) {
+    if (event.type == kInputEvent) {
+      inputReady = true;
+    } else if (event.type == kChildEvent) {
+      collectExited(event, changes);
+    } else if (event.signal == SIGCHLD) {
+      childrenChanged = true;
+    } else {
+      forwardSignal(event.signal);
+    }
+  }
+
+  if (childrenChanged) {
+    if (trackingChildren) {
+      collectStoppedAndContinued(changes);
+    } else {
+      collectChildren(changes);
+    }
+  }
+
+  try {
+    applyStateChanges(changes);
+  } catch (const STSHException& e) {
+    cerr << e.what() << endl;
+  }
+}
+
+/**
+ * Function: readlineWithEvents
+ * ----------------------------
+ * Event-loop counterpart to readline: reads the next line of input while
+ * continuing to service signals, so jobs are reaped promptly even while
+ * the user is in the middle of typing.
+ */
+static bool readlineWithEvents(string& line) {
+  rlbegin();
+  while (true) {
+    if (!rlbuffered()) {
+      bool inputReady;
+      dispatchEvents(true, inputReady);
+      if (!inputReady) continue;
+    }
+
+    bool eof;
+    if (rlcontinue(line, eof)) return !eof;
   }
 }
 
@@ -240,12 +837,24 @@ static void sigForward(int sig){
  * installSignalHandler is a wrapper around a more robust version of the
  * signal function we've been using all quarter.  Check out stsh-signal.cc
  * to see how it works.
+ *
+ * When eventLoop is true, SIGCHLD, SIGINT, and SIGTSTP are routed through
+ * the event loop rather than handled asynchronously.
  */
-static void installSignalHandlers() {
-  // Our signal handlers
-  installSignalHandler(SIGCHLD, sigChild);
-  installSignalHandler(SIGINT, sigForward);
-  installSignalHandler(SIGTSTP, sigForward);
+static void installSignalHandlers(bool eventLoop) {
+  if (eventLoop) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTSTP);
+    events.open(signals, STDIN_FILENO);
+  } else {
+    // Our signal handlers
+    installSignalHandler(SIGCHLD, sigChild, /* blockAll = */ false);
+    installSignalHandler(SIGINT, sigForward);
+    installSignalHandler(SIGTSTP, sigForward);
+  }
 
   // Default signal handlers
   installSignalHandler(SIGQUIT, [](int sig) { exit(0); });
@@ -254,166 +863,389 @@ static void installSignalHandlers() {
 }
 
 /**
- * Function: createJob
+ * Function: launchJob
  * -------------------
- * Creates a new job on behalf of the provided pipeline.
+ * Creates a new job on behalf of the provided pipeline, in the background
+ * or foreground as directed, and returns its number (or 0 if none of its
+ * processes could be launched).  Each stage is started by launchProcess
+ * (see stsh-launch.h), and the first process launched becomes the leader
+ * of the job's process group.  SIGCHLD stays blocked until every process
+ * has been recorded in the job list, so a child that exits right away
+ * can't be reaped before we know about it, and SIGINT and SIGTSTP are
+ * blocked along with it (see blockJobListSignals).  When announce is true, the
+ * job number and the pid of every process are printed.
+ *
+ * Scheduling settings given on the command line are applied by each stage
+ * to itself, but a background job demoted by --demote-bg is demoted from
+ * here, once all of its stages are running, so that an fg that follows
+ * right away always restores it afterward rather than racing with it.
  */
-static void createJob(const pipeline& p) {
-  int n = p.commands.size();
+static size_t launchJob(const pipeline& p, bool background, bool announce) {
+  size_t n = p.commands.size();
+  vector<STSHStagePlacement> placements =
+    planPlacement(p.placement.empty() ? defaultPlacement : parsePlacement(p.placement), n);
+  STSHPriority priority = parsePriority(p.priority);
+  bool demoted = p.priority.empty() && background && !backgroundPriority.empty();
+  int herefd = p.hereString.empty() ? -1 : openHereString(p.hereString);
   int fds[(n-1)*2];
-  pipe2(fds, O_CLOEXEC);
-  STSHJob& job = joblist.addJob(kForeground);
-  
-  if(p.background) {
-    job.setState(kBackground);
-    cout << "[" << to_string(job.getNum()) << "] ";
+  size_t pipeSize = p.pipeSize != 0 ? p.pipeSize : defaultPipeSize;
+  for (size_t i = 0; i + 1 < n; i++) {
+    pipe2(fds + 2*i, O_CLOEXEC);
+    if (pipeSize != 0) resizePipe(fds[2*i], pipeSize);
   }
 
-  // First Process  
-  pid_t pid0 = fork();
-  
-  if (pid0 != 0){
-    setpgid(pid0, pid0);
-    
-    job.addProcess(STSHProcess(pid0, p.commands[0]));    
-    
-    // Print each of the group ids
-    if(p.background) {
-      cout << job.getGroupID();
-      if( n == 1) cout << endl;
-    } else {
-    // If a process is running in the fg make sure it has keyboard control
-      int error = tcsetpgrp(STDIN_FILENO, pid0);
-      if (error < 0) {
-        throw STSHException("Failed to transfer STDIN control to foreground process.");
-      }
+  sigset_t existing;
+  blockJobListSignals(existing);
+  STSHJob& job = joblist.addJob(background ? kBackground : kForeground);
+  size_t num = job.getNum();
+  STSHTraceSpan launch("launch", num);
+  job.setPriority(!p.priority.empty() ? kExplicitPriority : demoted ? kDemotedPriority : kInteractivePriority);
+  int cgroupfd = -1;
+  if (cgroupsEnabled()) {
+    try {
+      job.setCgroup(createJobCgroup(num));
+      cgroupfd = openCgroupProcs(job.getCgroup());
+    } catch (const STSHException& e) {
+      cerr << e.what() << endl; // the job still runs, just uncontained
     }
-  } else {
-    setpgid(getpid(), getpid());
-    
-    if (!p.input.empty()) {
-        int fdin = open(p.input.c_str(), O_RDONLY);
-        dup2(fdin, STDIN_FILENO);
-        close(fdin);
+  }
+
+  if (announce) {
+    cout << "[" << to_string(num) << "]";
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    STSHStage stage;
+    stage.cmd = &p.commands[i];
+    stage.pgid = job.getGroupID();
+    stage.foreground = !background && ownsTerminal;
+    stage.paths = &paths;
+    if (!placements.empty()) stage.placement = &placements[i];
+    stage.cgroupfd = cgroupfd;
+    if (!priority.empty()) stage.priority = &priority;
+    if (i > 0) stage.infd = fds[2*(i-1)];
+    if (i < n-1) stage.outfd = fds[2*i + 1];
+    if (i == 0) {
+      stage.input = p.input;
+      if (herefd != -1) stage.infd = herefd;
     }
 
-    if (n==1) {
-        if (!p.output.empty()) {
-            int fdout;
-            if (access(p.output.c_str(), F_OK) != -1 ) {
-                fdout = open(p.output.c_str(), O_TRUNC | O_RDWR);
-            } else {
-                fdout = open(p.output.c_str(), O_CREAT | O_RDWR, 0644);
-            }
-            dup2(fdout, STDOUT_FILENO);
-            close(fdout);
-	} 
-    } else {
-        dup2(fds[1],STDOUT_FILENO);
-        close(fds[0]);
+    if (i == n-1) {
+      stage.output = p.output;
+      stage.append = p.append;
     }
-    
-    char *combined[kMaxArguments + 1];
-    combined[0] = (char *)p.commands[0].command;
-    
-    for (int i=1; i < (kMaxArguments + 1); i++) {
-        combined[i] = (char *)p.commands[0].tokens[i-1];
+
+    if (p.commands[i].error != NULL) stage.error = p.commands[i].error;
+    stage.errorToOutput = p.commands[i].errorToOutput;
+
+    pid_t pid;
+    try {
+      pid = launchProcess(stage);
+    } catch (const STSHException& e) {
+      cerr << e.what() << endl; // the rest of the pipeline still runs, as with a failed execvp
+      continue;
     }
 
-    execvp(combined[0], combined);
-    
-    if (n > 1){
-      close(fds[1]);
+    traceEvent("spawn", 'i', num, pid);
+    setpgid(pid, stage.pgid == 0 ? pid : stage.pgid);
+    joblist.addProcess(job, STSHProcess(pid, p.commands[i]));
+    if (events.isOpen() && trackingChildren) {
+      trackingChildren = events.watchChild(pid);
     }
 
-    throw(STSHException(string(p.commands[0].command) + ": Command not found."));
-    
-    exit(0);
+    // Print each of the group ids
+    if (announce) {
+      cout << " " << to_string(pid);
+    }
   }
-  
-  // Middle proccesses  
-  for (int i=1; i < (n-1); i++) {
-      pipe2(fds + (i*2), O_CLOEXEC);
-      pid_t pid_i = fork();
-      if (pid_i != 0){
-          setpgid(pid_i, pid0);
-          job.addProcess(STSHProcess(pid_i, p.commands[i]));    
-          
-	  // Print each of the group ids
-          if(p.background) {
-              cout << " " << to_string(pid_i);
-          }
-      } else {
-          setpgid(getpid(), pid0);
-          dup2(fds[(2*i) + 1], STDOUT_FILENO);
-          dup2(fds[2*(i-1)], STDIN_FILENO);
 
-          char *combined[kMaxArguments + 1];
-          combined[0] = (char *)p.commands[i].command;
-    
-          for (int j=1; j < (kMaxArguments + 1); j++) {
-              combined[j] = (char *)p.commands[i].tokens[j-1];
-          }
+  if (announce) {
+    cout << endl;
+  }
 
-          execvp(combined[0], combined);
-	  throw(STSHException(string(p.commands[i].command) + ": Command not found."));
-          exit(0);
-      }
+  // Close all fds in the parent
+  for (size_t i = 0; i < (n-1)*2; i++) {
+    close(fds[i]);
   }
 
-  // Last Process
-  if (n > 1){ 
-  pid_t pidl = fork();
+  if (herefd != -1) close(herefd);
+  if (cgroupfd != -1) close(cgroupfd);
+  if (demoted && !job.getProcesses().empty()) {
+    changePriority(job, backgroundPriority, "--demote-bg"); // from here, so a later fg can't be overtaken by it
+  }
 
-  if (pidl != 0){
-    setpgid(pidl, pid0);
-    job.addProcess(STSHProcess(pidl, p.commands[n-1]));
-    
-    // Print each of the group ids
-    if(p.background) {
-        cout << " " << to_string(pidl) << endl;
+  if (job.getProcesses().empty()) {
+    joblist.synchronize(job); // nothing could be launched, so discard the empty job
+    num = 0;
+  } else if (!background && ownsTerminal) {
+    // If a process is running in the fg make sure it has keyboard control
+    if (tcsetpgrp(STDIN_FILENO, job.getGroupID()) < 0) {
+      sigprocmask(SIG_SETMASK, &existing, NULL);
+      throw STSHException("Failed to transfer STDIN control to foreground process.");
     }
-  } else {
-    setpgid(getpid(), pid0);
-
-    // Read from the output of the previous child/children
-    dup2(fds[(2*n)-4],STDIN_FILENO);
-    // Write to a file if a path is specified
-    if (!p.output.empty()) {
-      int fdout;
-      if (access(p.output.c_str(), F_OK) != -1 ) {
-          fdout = open(p.output.c_str(), O_TRUNC | O_RDWR);
-      } else {
-          fdout = open(p.output.c_str(), O_CREAT | O_RDWR, 0644);
-      }
-      dup2(fdout, STDOUT_FILENO);
-      close(fdout);
+  }
+
+  sigprocmask(SIG_SETMASK, &existing, NULL);
+  return num;
+}
+
+/**
+ * Function: createJob
+ * -------------------
+ * Launches the provided pipeline as a new job, and, unless it's a
+ * background job, waits for it to finish or stop.  If the pipeline was
+ * prefixed with the time keyword, a report of the job's resource usage,
+ * stage by stage, is printed to stderr once the wait is over.  Timed
+ * background jobs aren't reported, but the usage builtin can report them
+ * once they've finished.
+ *
+ * Returns the job's exit status, as other shells define it: that of its
+ * last stage once it's finished, 128 + SIGTSTP if it stopped instead, 127 if
+ * none of it could be launched, and 0 for a background job.
+ */
+static int createJob(const pipeline& p) {
+  size_t num = launchJob(p, p.background, p.background);
+  if (num == 0) return 127;
+  if (p.background) return 0;
+
+  // Run fg proccess in fg
+  STSHTraceSpan wait("wait", num);
+  waitForFg();
+  if (joblist.containsJob(num)) {
+    if (p.timed) reportUsage(cerr, joblist.getJob(num));
+    return 128 + SIGTSTP;
+  }
+
+  if (p.timed) reportUsage(cerr, joblist.getFinishedJob(num));
+  return joblist.getForegroundStatus();
+}
+
+/**
+ * Type: ShellOptions
+ * ------------------
+ * Records the options understood by stsh itself.
+ */
+struct ShellOptions {
+  bool eventLoop = false;
+  bool hasCommand = false;
+  std::string command;  // the argument to -c
+  std::string script;   // the path to a script file
+};
+
+/**
+ * Function: extractShellOptions
+ * -----------------------------
+ * Pulls the options understood by stsh itself (as opposed to those
+ * understood by rlinit) out of the argument vector, leaving everything
+ * else in place for rlinit to process.
+ *
+ *   --launch=fork|spawn   selects the engine used to start processes
+ *   --event-loop          consumes signals through a signalfd/epoll event
+ *                         loop instead of asynchronous signal handlers
+ *   --no-builtin-stages   always executes cat and tee as external commands
+ *   --pipe-size=<size>    sets the capacity of the pipes between stages of
+ *                         every pipeline (unless overridden by a pipesize= prefix)
+ *   --cgroups             contains each job in a cgroup v2 control group of its
+ *                         own, which the limit builtin can constrain
+ *   --demote-bg[=<settings>]
+ *                         runs background jobs with lower CPU and I/O priority
+ *                         (see stsh-priority.h), by default sched=batch,ionice=idle,
+ *                         and restores the shell's own when fg brings them back
+ *   --placement=<spec>    places the stages of every job on CPUs and NUMA nodes
+ *                         as spec directs (see stsh-placement.h), unless
+ *                         overridden by a placement= prefix
+ *   --trace=<file>        records when lines are read and parsed, jobs are
+ *                         launched and waited on, and children change state,
+ *                         in Chrome's trace event format (see stsh-trace.h)
+ *   -c <commands>         runs the provided command line(s) and exits
+ *   <script>              runs the command lines in the named file and exits
+ */
+static void extractShellOptions(int& argc, char *argv[], ShellOptions& options) {
+  static const string kLaunchOption = "--launch=";
+  static const string kEventLoopOption = "--event-loop";
+  static const string kNoBuiltinStagesOption = "--no-builtin-stages";
+  static const string kPipeSizeOption = "--pipe-size=";
+  static const string kPlacementOption = "--placement=";
+  static const string kCgroupsOption = "--cgroups";
+  static const string kDemoteOption = "--demote-bg";
+  static const string kTraceOption = "--trace=";
+  static const string kCommandOption = "-c";
+  int kept = 1;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg.compare(0, kLaunchOption.size(), kLaunchOption) == 0) {
+      setLaunchMode(parseLaunchMode(arg.substr(kLaunchOption.size())));
+    } else if (arg == kEventLoopOption) {
+      options.eventLoop = true;
+    } else if (arg == kNoBuiltinStagesOption) {
+      setBuiltinStages(false);
+    } else if (arg.compare(0, kPipeSizeOption.size(), kPipeSizeOption) == 0) {
+      defaultPipeSize = parseSize(argv[i] + kPipeSizeOption.size(), "Option --pipe-size requires a size, as with --pipe-size=1M.");
+    } else if (arg.compare(0, kPlacementOption.size(), kPlacementOption) == 0) {
+      defaultPlacement = parsePlacement(arg.substr(kPlacementOption.size()));
+    } else if (arg.compare(0, kDemoteOption.size(), kDemoteOption) == 0 &&
+               (arg.size() == kDemoteOption.size() || arg[kDemoteOption.size()] == '=')) {
+      string settings = arg.size() == kDemoteOption.size() ? "sched=batch,ionice=idle" : arg.substr(kDemoteOption.size() + 1);
+      backgroundPriority = parsePriorityList(settings);
+      getInteractivePriority(); // captured now, before anything could change it
+    } else if (arg == kCgroupsOption) {
+      enableCgroups();
+    } else if (arg.compare(0, kTraceOption.size(), kTraceOption) == 0) {
+      openTrace(arg.substr(kTraceOption.size()));
+    } else if (arg == kCommandOption) {
+      if (++i == argc) throw STSHException("Option -c requires an argument.");
+      options.hasCommand = true;
+      options.command = argv[i];
+    } else if (arg[0] != '-' && options.script.empty() && !options.hasCommand) {
+      options.script = arg;
+    } else {
+      argv[kept++] = argv[i];
     }
+  }
+
+  argc = kept;
+  argv[argc] = NULL;
+}
 
-    char *combined[kMaxArguments + 1];
-    combined[0] = (char *)p.commands[n-1].command;
+/**
+ * Function: parseLine
+ * -------------------
+ * Parses a single command line, recording the time it takes when tracing.
+ */
+static unique_ptr<pipeline> parseLine(const string& line) {
+  STSHTraceSpan parse("parse");
+  return unique_ptr<pipeline>(new pipeline(line));
+}
 
-    for (int i=1; i < (kMaxArguments + 1); i++) {
-        combined[i] = (char *)p.commands[n-1].tokens[i-1];
+/**
+ * Function: parseScript
+ * ---------------------
+ * Parses every command line in the length characters addressed by text,
+ * which hold the contents of a script (or the argument to -c), appending
+ * the resulting pipelines to the provided vector.  Blank lines and lines
+ * starting with '#' are skipped.  Throws an STSHException that names the
+ * offending line if any of them has a syntax error.
+ */
+static void parseScript(const string& name, const char *text, size_t length,
+                        vector<unique_ptr<pipeline>>& pipelines) {
+  const char *end = text + length;
+  size_t lineno = 0;
+  for (const char *start = text; start < end; ) {
+    const char *newline = static_cast<const char *>(memchr(start, '\n', end - start));
+    if (newline == NULL) newline = end;
+    string line(start, newline);
+    start = newline + 1;
+    lineno++;
+    trim(line);
+    if (line.empty() || line[0] == '#') continue;
+    try {
+      pipelines.push_back(parseLine(line));
+    } catch (const STSHException& e) {
+      throw STSHException(name + ":" + to_string(lineno) + ": " + e.what());
     }
+  }
+}
 
-    close(fds[(n-2)*2+1]);
-    execvp(combined[0], combined);
-    close(fds[(n-2)*2]);
-    throw(STSHException(string(p.commands[n-1].command) + ": Command not found.")); 
-    exit(0);
+/**
+ * Function: loadScriptFile
+ * ------------------------
+ * Maps the named file into memory (so it's never copied through a stdio
+ * buffer) and parses it as parseScript does.  Throws an STSHException if
+ * the file can't be read.
+ */
+static void loadScriptFile(const string& path, vector<unique_ptr<pipeline>>& pipelines) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) < 0) {
+    string error = path + ": " + strerror(errno);
+    if (fd >= 0) close(fd);
+    throw STSHException(error);
   }
+
+  if (info.st_size == 0) {
+    close(fd);
+    return;
   }
-  
-  // Close all fds in the parent
-  for (int i = 0; i < (n-1)*2 ; i++){
-    close(fds[i]);
-  } 
 
-  // Run fg proccess in fg
-  if(!p.background) {
-    waitForFg();
+  void *text = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (text == MAP_FAILED) {
+    throw STSHException(path + ": " + strerror(errno));
   }
+
+  try {
+    parseScript(path, static_cast<const char *>(text), info.st_size, pipelines);
+  } catch (const STSHException& e) {
+    munmap(text, info.st_size);
+    throw;
+  }
+
+  munmap(text, info.st_size); // every pipeline has its own copy of what it needs
+}
+
+/**
+ * Function: runPipelines
+ * ----------------------
+ * Runs every one of the provided pipelines in order, without prompting,
+ * line editing, or history along the way.  Returns the exit status for stsh,
+ * which, as with other shells, is that of the last pipeline: the exit status
+ * of its job (see createJob), 0 for a builtin, or 1 if it failed outright.
+ * Each status is recorded in lastStatus as the pipeline finishes, so quit
+ * and exit can use it.
+ */
+static int runPipelines(const vector<unique_ptr<pipeline>>& pipelines) {
+  pid_t stshpid = getpid();
+  for (const unique_ptr<pipeline>& p: pipelines) {
+    maybeFlushTrace();
+    drainChildEvents(); // so builtins see every job as it stands
+    try {
+      bool builtin = handleBuiltin(*p);
+      lastStatus = builtin ? 0 : createJob(*p);
+    } catch (const STSHException& e) {
+      cerr << e.what() << endl;
+      if (getpid() != stshpid) exit(0); // if exception is thrown from child process, kill it
+      lastStatus = 1;
+    }
+  }
+
+  return lastStatus;
+}
+
+/**
+ * Function: runScript
+ * -------------------
+ * Runs the script (or argument to -c) held in the length characters
+ * addressed by text.  Every line is parsed before any of them runs, so a
+ * syntax error anywhere means nothing runs at all.  Returns the exit status
+ * for stsh.
+ */
+static int runScript(const string& name, const char *text, size_t length) {
+  vector<unique_ptr<pipeline>> pipelines;
+  try {
+    parseScript(name, text, length, pipelines);
+  } catch (const STSHException& e) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  return runPipelines(pipelines);
+}
+
+/**
+ * Function: runScriptFile
+ * -----------------------
+ * Runs the named script file, just as runScript does.
+ */
+static int runScriptFile(const string& path) {
+  vector<unique_ptr<pipeline>> pipelines;
+  try {
+    loadScriptFile(path, pipelines);
+  } catch (const STSHException& e) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
+  return runPipelines(pipelines);
 }
 
 /**
@@ -421,25 +1253,43 @@ static void createJob(const pipeline& p) {
   --------------
  * Defines the entry point for a process running stsh.
  * The main function is little more than a read-eval-print
- * loop (i.e. a repl).  
+ * loop (i.e. a repl), unless it's been asked to run a script
+ * or the argument to -c instead.
  */
 int main(int argc, char *argv[]) {
   pid_t stshpid = getpid();
-  installSignalHandlers();
+  ShellOptions options;
+  try {
+    registerBuiltins();
+    extractShellOptions(argc, argv, options);
+    installSignalHandlers(options.eventLoop);
+  } catch (const STSHException& e) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+
   rlinit(argc, argv); // configures stsh-readline library so readline works properly
+  if (options.hasCommand) return runScript("-c", options.command.data(), options.command.size());
+  if (!options.script.empty()) return runScriptFile(options.script);
   while (true) {
     string line;
-    if (!readline(line)) break;
+    flushTrace(); // while the shell would be idle anyway
+    traceEvent("read", 'B');
+    bool more = options.eventLoop ? readlineWithEvents(line) : readline(line);
+    traceEvent("read", 'E');
+    if (!more) break;
     if (line.empty()) continue;
+    drainChildEvents(); // so builtins see every job as it stands
     try {
-      pipeline p(line);
-      bool builtin = handleBuiltin(p);
-      if (!builtin) createJob(p);
+      unique_ptr<pipeline> p = parseLine(line);
+      bool builtin = handleBuiltin(*p);
+      lastStatus = builtin ? 0 : createJob(*p);
     } catch (const STSHException& e) {
       cerr << e.what() << endl;
       if (getpid() != stshpid) exit(0); // if exception is thrown from child process, kill it
+      lastStatus = 1;
     }
   }
 
-  return 0;
+  return lastStatus;
 }